@@ -0,0 +1,473 @@
+#define TEXTEDITOR_NO_MAIN
+#include "texteditor.c"
+
+#define BENCH_ROWS 256
+#define BENCH_LONG_ROWS 16
+#define BENCH_LONG_BYTES (16 * 1024)
+#define BENCH_BUFFER_COPIES 16
+#define BENCH_FRAME_ROWS 64
+#define BENCH_ROUNDS 15
+#define BENCH_ROUND_NS 20000000LL
+#define BENCH_THRESHOLD 10.0
+#define BENCH_MAX_RESULTS 64
+
+typedef struct benchinput {
+	const char *name;
+	erow *rows;
+	int numrows;
+	unsigned char *hl;
+	rowtable buf;
+	int numbuf;
+}benchinput;
+
+typedef struct bench {
+	const char *name;
+	void (*run)(benchinput *in, long long n);
+	int perinput;
+	int buffer;
+}bench;
+
+typedef struct benchresult {
+	char name[64];
+	double ns;
+	double spread;
+	double bytes;
+	double allocs;
+}benchresult;
+
+typedef struct benchcase {
+	bench *b;
+	benchinput *in;
+	long long n;
+	double *ns;
+	long long allocs;
+	long long bytes;
+}benchcase;
+
+void *__libc_malloc(size_t size);
+
+void *__libc_calloc(size_t n, size_t size);
+
+void *__libc_realloc(void *ptr, size_t size);
+
+void __libc_free(void *ptr);
+
+long long benchallocs;
+
+long long benchbytes;
+
+volatile long long benchsink;
+
+unsigned int benchseed = 12345;
+
+const char *benchwords[] = {
+	"if", "counter", "return", "buffer", "int", "x", "while", "retur", "unsigned", "len",
+	"struct", "integer", "static", "row", "void", "editorUpdateRow", "char", "i", "typedef", "ab"
+};
+
+#define NUM_BENCH_WORDS (sizeof(benchwords) / sizeof(benchwords[0]))
+
+unsigned int benchRand();
+
+void benchRow(erow *row, const char *s, int len);
+
+void benchGenerate(int kind, char *out, int len);
+
+void benchInput(benchinput *in, const char *name, int numrows, int len, int kind);
+
+void benchLoad(benchinput *in);
+
+void benchUse(benchinput *in);
+
+void benchDetach();
+
+void benchUpdateRow(benchinput *in, long long n);
+
+void benchCxToRx(benchinput *in, long long n);
+
+void benchRxToCx(benchinput *in, long long n);
+
+void benchHighlight(benchinput *in, long long n);
+
+void benchIsKeyword(benchinput *in, long long n);
+
+void benchAbAppend(benchinput *in, long long n);
+
+void benchRowsToStr(benchinput *in, long long n);
+
+void benchFind(benchinput *in, long long n);
+
+long long benchNow();
+
+int benchDoubleCmp(const void *a, const void *b);
+
+void benchCalibrate(benchcase *c);
+
+void benchRound(benchcase *c, int round);
+
+void benchSummarize(benchcase *c, int rounds, benchresult *r);
+
+int benchLoadBaseline(const char *path, benchresult *base, int max);
+
+int benchSaveBaseline(const char *path, benchresult *res, int n);
+
+void *malloc(size_t size) {
+	benchallocs++;
+	benchbytes += size;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+	benchallocs++;
+	benchbytes += n * size;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	benchallocs++;
+	benchbytes += size;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+
+unsigned int benchRand() {
+	benchseed = benchseed * 1103515245 + 12345;
+	return benchseed >> 8;
+}
+
+void benchRow(erow *row, const char *s, int len) {
+	memset(row, 0, sizeof(erow));
+	row->size = len;
+	row->chars = memAlloc(MEM_TEXT, len + 1);
+	memcpy(row->chars, s, len);
+	row->chars[len] = '\0';
+	row->disk = -1;
+	editorUpdateRow(row);
+}
+
+void benchGenerate(int kind, char *out, int len) {
+	const char *utf8[] = {"日本", "é", "ü", "ß", "€", "中文", "ñ"};
+	int i = 0;
+	while(i < len) {
+		char tok[32];
+		int n;
+		unsigned int r = benchRand();
+		switch(kind) {
+			case 0:
+				n = snprintf(tok, sizeof(tok), "%s%s", r % 3 ? "\t" : "\t\t", benchwords[r % NUM_BENCH_WORDS]);
+				break;
+			case 1:
+				n = snprintf(tok, sizeof(tok), "%s%c", benchwords[r % NUM_BENCH_WORDS], "(){};,\" /"[r % 9]);
+				break;
+			case 2:
+				n = snprintf(tok, sizeof(tok), "%s%c", keywords[r % NUM_KEYWORDS], " ();"[r % 4]);
+				break;
+			case 3:
+				tok[0] = 1 + r % 255;
+				if(tok[0] == '\n' || tok[0] == '\r') tok[0] = ' ';
+				n = 1;
+				break;
+			default:
+				n = snprintf(tok, sizeof(tok), "%s ", r % 2 ? utf8[r % 7] : benchwords[r % NUM_BENCH_WORDS]);
+				break;
+		}
+		if(i + n > len) n = kind == 3 ? len - i : 0;
+		if(n == 0) break;
+		memcpy(&out[i], tok, n);
+		i += n;
+	}
+	while(i < len) out[i++] = ' ';
+}
+
+void benchInput(benchinput *in, const char *name, int numrows, int len, int kind) {
+	char *buf = malloc(len);
+	in->name = name;
+	in->rows = malloc(sizeof(erow) * numrows);
+	in->numrows = numrows;
+	int maxr = 0;
+	for(int i = 0; i < numrows; i++) {
+		int n = len / 2 + benchRand() % (len / 2 + 1);
+		benchGenerate(kind, buf, n);
+		benchRow(&in->rows[i], buf, n);
+		if(in->rows[i].rsize > maxr) maxr = in->rows[i].rsize;
+	}
+	in->hl = malloc(maxr + 1);
+	free(buf);
+}
+
+void benchLoad(benchinput *in) {
+	memset(&E.row, 0, sizeof(rowtable));
+	E.numrows = 0;
+	for(int k = 0; k < BENCH_BUFFER_COPIES; k++)
+		for(int i = 0; i < in->numrows; i++)
+			editorInsertRow(E.numrows, in->rows[i].chars, in->rows[i].size);
+	in->buf = E.row;
+	in->numbuf = E.numrows;
+}
+
+void benchUse(benchinput *in) {
+	if(E.row.chunk == in->buf.chunk) return;
+	E.row = in->buf;
+	E.numrows = in->numbuf;
+	E.bytes.valid = 0;
+	editorByteIndex();
+}
+
+void benchDetach() {
+	memset(&E.row, 0, sizeof(rowtable));
+	E.numrows = 0;
+	E.bytes.valid = 0;
+	E.wrap.valid = 0;
+}
+
+void benchUpdateRow(benchinput *in, long long n) {
+	for(long long i = 0, j = 0; i < n; i++, j = j + 1 == in->numrows ? 0 : j + 1)
+		editorUpdateRow(&in->rows[j]);
+}
+
+void benchCxToRx(benchinput *in, long long n) {
+	long long sum = 0;
+	for(long long i = 0, j = 0; i < n; i++, j = j + 1 == in->numrows ? 0 : j + 1)
+		sum += editorRowCxToRx(&in->rows[j], in->rows[j].size);
+	benchsink += sum;
+}
+
+void benchRxToCx(benchinput *in, long long n) {
+	long long sum = 0;
+	for(long long i = 0, j = 0; i < n; i++, j = j + 1 == in->numrows ? 0 : j + 1)
+		sum += editorRowRxToCx(&in->rows[j], in->rows[j].wrapw);
+	benchsink += sum;
+}
+
+void benchHighlight(benchinput *in, long long n) {
+	for(long long i = 0, j = 0; i < n; i++, j = j + 1 == in->numrows ? 0 : j + 1)
+		highlight_buffer(in->rows[j].render, in->rows[j].rsize, in->hl);
+}
+
+void benchIsKeyword(benchinput *in, long long n) {
+	long long sum = 0;
+	(void)in;
+	for(long long i = 0, j = 0; i < n; i++, j = j + 1 == NUM_BENCH_WORDS ? 0 : j + 1)
+		sum += is_keyword(benchwords[j]);
+	benchsink += sum;
+}
+
+void benchAbAppend(benchinput *in, long long n) {
+	abuf ab = ABUF_INIT;
+	for(long long i = 0, j = 0; i < n; i++, j = j + 1 == in->numrows ? 0 : j + 1) {
+		abAppendHl(&ab, in->rows[j].render, in->rows[j].rsize, in->hl);
+		if(i % BENCH_FRAME_ROWS == BENCH_FRAME_ROWS - 1) {
+			abFree(&ab);
+			ab = (abuf)ABUF_INIT;
+		}
+	}
+	abFree(&ab);
+}
+
+void benchRowsToStr(benchinput *in, long long n) {
+	(void)in;
+	for(long long i = 0; i < n; i++) {
+		long long len;
+		char *buf = editorRowsToStr(&len);
+		benchsink += buf[len - 1];
+		free(buf);
+	}
+}
+
+void benchFind(benchinput *in, long long n) {
+	(void)in;
+	for(long long i = 0; i < n; i++)
+		editorFindCallback("zqxv", 0);
+}
+
+long long benchNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int benchDoubleCmp(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+void benchCalibrate(benchcase *c) {
+	long long n = 1, t;
+	if(c->b->buffer)
+		benchUse(c->in);
+	else
+		benchDetach();
+	while(1) {
+		t = benchNow();
+		c->b->run(c->in, n);
+		t = benchNow() - t;
+		if(t >= BENCH_ROUND_NS / 10) break;
+		n *= 2;
+	}
+	c->n = n * BENCH_ROUND_NS / (t ? t : 1) + 1;
+}
+
+void benchRound(benchcase *c, int round) {
+	if(c->b->buffer)
+		benchUse(c->in);
+	else
+		benchDetach();
+	long long allocs = benchallocs, bytes = benchbytes;
+	long long t = benchNow();
+	c->b->run(c->in, c->n);
+	c->ns[round] = (double)(benchNow() - t) / c->n;
+	c->allocs += benchallocs - allocs;
+	c->bytes += benchbytes - bytes;
+}
+
+void benchSummarize(benchcase *c, int rounds, benchresult *r) {
+	double dev[rounds];
+	qsort(c->ns, rounds, sizeof(double), benchDoubleCmp);
+	r->ns = c->ns[rounds / 2];
+	for(int i = 0; i < rounds; i++)
+		dev[i] = fabs(c->ns[i] - r->ns);
+	qsort(dev, rounds, sizeof(double), benchDoubleCmp);
+	r->spread = r->ns > 0 ? 100 * dev[rounds / 2] / r->ns : 0;
+	r->allocs = (double)c->allocs / (c->n * rounds);
+	r->bytes = (double)c->bytes / (c->n * rounds);
+}
+
+int benchLoadBaseline(const char *path, benchresult *base, int max) {
+	FILE *fp = fopen(path, "r");
+	if(!fp) return -1;
+	char line[256];
+	int n = 0;
+	while(n < max && fgets(line, sizeof(line), fp)) {
+		if(line[0] == '#') continue;
+		benchresult *r = &base[n];
+		if(sscanf(line, "%63s %lf %lf %lf %lf", r->name, &r->ns, &r->spread, &r->bytes, &r->allocs) == 5) n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+int benchSaveBaseline(const char *path, benchresult *res, int n) {
+	FILE *fp = fopen(path, "w");
+	if(!fp) return -1;
+	fprintf(fp, "# name ns/op +-%% B/op allocs/op\n");
+	for(int i = 0; i < n; i++)
+		fprintf(fp, "%s %.2f %.2f %.2f %.4f\n", res[i].name, res[i].ns, res[i].spread, res[i].bytes, res[i].allocs);
+	return fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+	int rounds = BENCH_ROUNDS;
+	double threshold = BENCH_THRESHOLD;
+	const char *save = NULL, *compare = NULL, *filter = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "c:r:s:t:")) != -1) {
+		switch(opt) {
+			case 'c':
+				compare = optarg;
+				break;
+			case 'r':
+				rounds = atoi(optarg);
+				break;
+			case 's':
+				save = optarg;
+				break;
+			case 't':
+				threshold = atof(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-r rounds] [-s baseline] [-c baseline] [-t percent] [filter]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if(optind < argc) filter = argv[optind];
+	if(rounds < 1) rounds = 1;
+
+	E.snapgen = -1;
+	E.mark = -1;
+	benchinput inputs[5];
+	benchInput(&inputs[0], "tabs", BENCH_ROWS, 96, 0);
+	benchInput(&inputs[1], "long", BENCH_LONG_ROWS, BENCH_LONG_BYTES, 1);
+	benchInput(&inputs[2], "keywords", BENCH_ROWS, 96, 2);
+	benchInput(&inputs[3], "binary", BENCH_ROWS, 96, 3);
+	benchInput(&inputs[4], "utf8", BENCH_ROWS, 96, 4);
+	int numinputs = sizeof(inputs) / sizeof(inputs[0]);
+	for(int k = 0; k < numinputs; k++)
+		benchLoad(&inputs[k]);
+
+	bench benches[] = {
+		{"update_row", benchUpdateRow, 1, 0},
+		{"cx_to_rx", benchCxToRx, 1, 0},
+		{"rx_to_cx", benchRxToCx, 1, 0},
+		{"highlight", benchHighlight, 1, 0},
+		{"is_keyword", benchIsKeyword, 0, 0},
+		{"ab_append", benchAbAppend, 1, 0},
+		{"rows_to_str", benchRowsToStr, 1, 1},
+		{"find", benchFind, 1, 1}
+	};
+	int numbenches = sizeof(benches) / sizeof(benches[0]);
+
+	benchcase cases[BENCH_MAX_RESULTS];
+	benchresult base[BENCH_MAX_RESULTS], res[BENCH_MAX_RESULTS];
+	int numbase = 0, numres = 0, failed = 0;
+	if(compare && (numbase = benchLoadBaseline(compare, base, BENCH_MAX_RESULTS)) == -1) {
+		fprintf(stderr, "Can't read baseline %s: %s\n", compare, strerror(errno));
+		exit(1);
+	}
+	for(int i = 0; i < numbenches; i++) {
+		for(int k = 0; k < (benches[i].perinput ? numinputs : 1); k++) {
+			benchresult *r = &res[numres];
+			if(benches[i].perinput)
+				snprintf(r->name, sizeof(r->name), "%s/%s", benches[i].name, inputs[k].name);
+			else
+				snprintf(r->name, sizeof(r->name), "%s", benches[i].name);
+			if(filter && !strstr(r->name, filter)) continue;
+			benchcase *c = &cases[numres++];
+			memset(c, 0, sizeof(benchcase));
+			c->b = &benches[i];
+			c->in = &inputs[k];
+			c->ns = malloc(sizeof(double) * rounds);
+			benchCalibrate(c);
+		}
+	}
+	for(int round = 0; round < rounds; round++)
+		for(int i = 0; i < numres; i++)
+			benchRound(&cases[i], round);
+
+	printf("%-22s %10s %6s %10s %9s", "benchmark", "ns/op", "+-%", "B/op", "allocs/op");
+	if(compare) printf(" %10s %8s", "base", "delta");
+	printf("\n");
+	for(int i = 0; i < numres; i++) {
+		benchresult *r = &res[i];
+		benchSummarize(&cases[i], rounds, r);
+		printf("%-22s %10.1f %6.1f %10.1f %9.2f", r->name, r->ns, r->spread, r->bytes, r->allocs);
+
+		benchresult *b = NULL;
+		for(int j = 0; j < numbase && !b; j++)
+			if(strcmp(base[j].name, r->name) == 0) b = &base[j];
+		if(b) {
+			double noise = fmax(threshold, r->spread + b->spread);
+			int slow = r->ns > b->ns * (1 + noise / 100);
+			int grew = r->bytes > b->bytes * (1 + threshold / 100) + 0.5;
+			printf(" %10.1f %+7.1f%%%s", b->ns, 100 * (r->ns - b->ns) / b->ns,
+				slow ? " SLOWER" : grew ? " MORE MEMORY" : "");
+			failed += slow || grew;
+		}
+		else if(compare) {
+			printf(" %10s", "new");
+		}
+		printf("\n");
+	}
+
+	if(save && benchSaveBaseline(save, res, numres) == -1) {
+		fprintf(stderr, "Can't write baseline %s: %s\n", save, strerror(errno));
+		exit(1);
+	}
+	if(failed) {
+		printf("%d benchmark%s regressed by more than %.0f%%\n", failed, failed == 1 ? "" : "s", threshold);
+		return 1;
+	}
+	return 0;
+}
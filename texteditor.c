@@ -1,10 +1,10 @@
 //TODO: check terminal has colors
-//TODO: limit how much big files can be opened
 //TODO: add bindings help page
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE
 #define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
 
 #include <ncurses.h>
 #include <stdio.h>
@@ -16,36 +16,395 @@
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <locale.h>
+#include <malloc.h>
+#include <wchar.h>
+#include <wctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define TAB_STOP 4
 #define QUIT_TIMES 1
 
-#define ctrl(k) ((k) & 0x1f)
+#define COLD_MIN_BYTES (16 * 1024 * 1024)
+#define COLD_BLOCK_BYTES (64 * 1024)
+#define COLD_HOT_ROWS 1024
+#define COLD_AGE 1024
+#define COLD_SCAN_ROWS 8192
+#define COLD_HASH_BITS 12
 
-typedef struct stack {
-	int ch;
-	int cx;
-	int cy;
-	int ins;
-	struct stack *next;
-}stack;
+#define FENWICK_BLOCK 256
+#define ROW_CHUNK 256
+
+#define AUTOSAVE_INTERVAL 30
+#define AUTOSAVE_SUFFIX ".autosave"
+#define SAVE_POLL_MS 250
+
+#define PAGER_WINDOW (16 * 1024 * 1024)
+#define PAGER_CHUNK (1024 * 1024)
+#define PAGER_INDEX_STRIDE 4096
+#define PAGER_MAX_COLUMN (1024 * 1024)
+
+#define UNDO_CHECK_EDITS 256
+#define UNDO_MAX_CHECKS 32
+#define UNDO_CHECK_BYTES (64 * 1024 * 1024)
+#define UNDO_COMPACT_SECS 60
+#define UNDO_KEEP_MIN 100
+
+#define INDEX_MAX_WORD 64
+#define INDEX_CANDIDATES 64
+#define INDEX_JUMP_MATCHES 8
+
+#define BRACKET_LEAF_ROWS 16
+#define BRACKET_PATH 4
+#define BRACKET_NONE (1 << 29)
+
+#define DIFF_GREEDY_ROWS 1024
+#define DIFF_MAX_WORK (16 * 1024 * 1024)
+
+#define IDLE_SLICE_US 2000
+
+#define HL_PAIR 0x3f
+#define HL_BOLD 0x40
+#define HL_REVERSE 0x80
+
+#define VT_MIN_GAP 8
+
+#define SESSION_MAGIC "TXSESS01"
+#define SESSION_DIR "texteditor"
+
+#define FILTER_BUF (64 * 1024)
+#define FILTER_IOV 1024
+#define FILTER_ERR 80
+#define FILTER_POLL_MS 200
+#define FILTER_KILL_MS 500
+#define FILTER_KEYS 64
+
+#define MEM_MB (1024 * 1024)
+#define MEM_WARN_SECS 5
+#define MEM_SHED_MS 1000
 
-typedef struct undo_stack {
-	stack *top;
-}undo_stack;
+#define ctrl(k) ((k) & 0x1f)
 
-typedef struct redo_stack {
-	stack *top;
-}redo_stack;
+typedef struct coldblock {
+	char *data;
+	int clen;
+	int len;
+	int refs;
+}coldblock;
 
 typedef struct erow {
 	int size;
 	int rsize;
+	int ascii;
+	int gen;
+	int indexed;
+	unsigned int stamp;
+	unsigned int hash;
+	unsigned char hashed;
+	unsigned char diff;
+	unsigned char wrapwide;
+	int wrapw;
+	int disk;
 	char *chars;
 	char *render;
+	unsigned char *hl;
+	coldblock *cold;
+	int coldoff;
 }erow;
 
+typedef struct rowchunk {
+	int n;
+	int gen;
+	erow row[ROW_CHUNK];
+}rowchunk;
+
+typedef struct rowtable {
+	rowchunk **chunk;
+	int *start;
+	int numchunks;
+	int hint;
+}rowtable;
+
+typedef struct fenwickblock {
+	int n;
+	long long sum;
+	int val[FENWICK_BLOCK];
+}fenwickblock;
+
+typedef struct fenwick {
+	fenwickblock **blocks;
+	long long *tree;
+	int *count;
+	int numblocks;
+	int n;
+	int valid;
+}fenwick;
+
+typedef struct snapshot {
+	rowtable row;
+	int numrows;
+	int gen;
+	struct snapshot *next;
+}snapshot;
+
+enum gravekind {
+	GRAVE_TEXT,
+	GRAVE_COLD,
+	GRAVE_ROWS
+};
+
+typedef struct grave {
+	void *ptr;
+	int kind;
+	int birth;
+	int death;
+}grave;
+
+enum undokind {
+	UNDO_ROOT,
+	UNDO_INSERT,
+	UNDO_DELETE,
+	UNDO_MERGED,
+	UNDO_BULK
+};
+
+typedef struct undonode {
+	int kind;
+	int ch;
+	char *text;
+	int len;
+	int cx;
+	int cy;
+	int seq;
+	int depth;
+	time_t time;
+	snapshot *check;
+	erow *rows;
+	int numrows;
+	struct undonode *parent;
+	struct undonode *child;
+	struct undonode *children;
+	struct undonode *sibling;
+}undonode;
+
+typedef struct undotree {
+	undonode *root;
+	undonode *cur;
+	undonode **nodes;
+	int numnodes;
+	undonode **checks;
+	int numchecks;
+	int compacted;
+}undotree;
+
+typedef struct wordtok {
+	char *word;
+	int len;
+	int count;
+	int *rows;
+	int numrows;
+	int caprows;
+	int epoch;
+	int sorted;
+}wordtok;
+
+typedef struct rowop {
+	int at;
+	int n;
+}rowop;
+
+typedef struct wordindex {
+	wordtok *tok;
+	int numtok;
+	int *hash;
+	int hashsize;
+	int *sorted;
+	int numsorted;
+	rowop *log;
+	int numlog;
+	int sealed;
+	int pending;
+	int low;
+	int cand[INDEX_CANDIDATES];
+	int numcand;
+	int curcand;
+	int candcx;
+	int candcy;
+	int candplen;
+	int candlen;
+}wordindex;
+
+typedef struct bracketsum {
+	int delta[2];
+	int min[2];
+	int minclose[2];
+	unsigned char exit[2];
+	int rows;
+}bracketsum;
+
+typedef struct brackettree {
+	bracketsum *node;
+	int size;
+	int numleaves;
+	int valid;
+	int building;
+	int buildleaf;
+	int version;
+	int *ev;
+	int evcap;
+	int cachecx;
+	int cachecy;
+	int cacheversion;
+	int depth;
+	int numpath;
+	int path[BRACKET_PATH][2];
+	char pathch[BRACKET_PATH];
+	int closerow;
+	int closecol;
+}brackettree;
+
+enum diffmark {
+	DIFF_SAME,
+	DIFF_ADD,
+	DIFF_CHANGE,
+	DIFF_DEL
+};
+
+typedef struct diffstate {
+	unsigned int *disk;
+	int numdisk;
+	snapshot *base;
+	int hashed;
+	int enabled;
+	int lo;
+	int hi;
+	int taildel;
+	long long work;
+	int plain;
+	struct stat st;
+}diffstate;
+
+typedef struct sessionhdr {
+	char magic[8];
+	long long size;
+	long long mtime;
+	long long mtimensec;
+	unsigned long long ino;
+	unsigned long long dev;
+	int cx, cy;
+	int rowoff, coloff;
+	int numrows;
+	int numleaves;
+	int pathlen;
+	int reserved;
+}sessionhdr;
+
+typedef struct saver {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	snapshot *snap;
+	char *path;
+	int manual;
+	int done;
+	int err;
+	long long written;
+	int dirty;
+	int pending;
+	int interval;
+	int lastdirty;
+	time_t last;
+}saver;
+
+typedef struct pager {
+	int fd;
+	long long size;
+	char *map;
+	long long mapoff;
+	long long maplen;
+	long long top;
+	long long topline;
+	long long *index;
+	long long numindex;
+	long long lines;
+	long long scanned;
+	int indexed;
+	pthread_t thread;
+	pthread_mutex_t lock;
+}pager;
+
+typedef struct filterjob {
+	pid_t pid;
+	int in;
+	int out;
+	int err;
+	int row;
+	int end;
+	int off;
+	erow *rows;
+	int numrows;
+	int cap;
+	char *line;
+	int linelen;
+	int linecap;
+	char errmsg[FILTER_ERR];
+	int errlen;
+}filterjob;
+
+typedef struct vtbuf {
+	char *b;
+	int len;
+	int cap;
+}vtbuf;
+
+typedef struct vtscreen {
+	int enabled;
+	int rows;
+	int cols;
+	int sgr;
+	int bold;
+	int rev;
+	unsigned char fg[3];
+	unsigned char bg[3];
+	int cy, cx;
+	int show;
+	vtbuf *line;
+	vtbuf out;
+}vtscreen;
+
+enum memtag {
+	MEM_TEXT,
+	MEM_RENDER,
+	MEM_ROWS,
+	MEM_UNDO,
+	MEM_COLD,
+	MEM_INDEX,
+	MEM_SCREEN,
+	MEM_TAGS
+};
+
+const char *memnames[MEM_TAGS] = {"text", "render", "rows", "undo", "cold", "index", "screen"};
+
+typedef struct memstats {
+	long long used[MEM_TAGS];
+	long long budget[MEM_TAGS];
+	long long limit;
+	time_t warned;
+	long long shed;
+}memstats;
+
 struct editorConfig {
 	int cx, cy;
 	int rx;
@@ -55,20 +414,42 @@ struct editorConfig {
 	int cols;
 	int numrows;
 	int line_width;
-	erow *row;
+	rowtable row;
 	int dirty;
 	char *filename;
-	char statusmsg[100];
+	char statusmsg[160];
 	time_t statusmsg_time;
-	undo_stack u;
-	redo_stack r;
+	undotree undo;
+	wordindex index;
+	brackettree brackets;
+	diffstate diff;
+	int coldenabled;
+	unsigned int tick;
+	int coldscan;
+	coldblock *coldblk;
+	char *coldbuf;
+	fenwick bytes;
+	fenwick wrap;
+	int mark;
+	int softwrap;
+	int wrapcols;
+	int wrapoff;
+	int gen;
+	int snapgen;
+	snapshot *snaps;
+	grave *graves;
+	int numgraves;
+	saver save;
+	pager *pager;
+	vtscreen vt;
+	memstats mem;
 };
 
 struct editorConfig E;
 
 typedef struct abuf {
 	char *b;
-	chtype *c;
+	unsigned char *c;
 	int len;
 }abuf;
 
@@ -76,10 +457,62 @@ typedef struct abuf {
 
 void die(const char *s);
 
+void *memAlloc(int tag, size_t size);
+
+void *memRealloc(int tag, void *ptr, size_t size);
+
+void memFree(int tag, void *ptr);
+
+long long memTotal();
+
+int memOver(int tag);
+
+int memOverLimit();
+
+int memParse(const char *spec);
+
+void memDropRender();
+
+int memDropBuffer();
+
+void memEnforce();
+
+char *memFormat(long long n, char *buf);
+
+void memReport();
+
 void abAppend(abuf *ab, const char *s, int len);
 
+void abAppendHl(abuf *ab, const char *s, int len, const unsigned char *hl);
+
+void abAppendColor(abuf *ab, const char *s, int len, unsigned char color);
+
 void abFree(abuf *ab);
 
+int utf8Decode(const char *s, int len, int *cp);
+
+int utf8Encode(int cp, char *out);
+
+int utf8Width(int cp);
+
+int editorIsAscii(const char *s, int len);
+
+int editorRowNextCx(erow *row, int cx);
+
+int editorRowPrevCx(erow *row, int cx);
+
+int editorRowPrevCp(erow *row, int cx);
+
+int editorRowSnapCx(erow *row, int cx);
+
+int editorRenderByteToRx(erow *row, int off);
+
+void editorAppendSpan(abuf *ab, const char *s, int len, int ascii, int coloff, int width, const unsigned char *hl);
+
+void editorPutStr(const char *s, int len);
+
+int editorReadUtf8(int c);
+
 int editorRowCxToRx(erow *row, int cx);
 
 int editorRowRxToCx(erow *row, int rx);
@@ -88,25 +521,49 @@ void editorScroll();
 
 void editorDrawRows(abuf *ab);
 
-void editorDrawStatusBar();
+void editorDrawStatusBar(abuf *ab);
 
-void editorDrawMsgBar();
+void editorDrawMsgBar(abuf *ab);
 
 int is_keyword(const char *word);
 
-void highlight_buffer(const char *buffer);
+void highlight_buffer(const char *buffer, int len, unsigned char *hl);
+
+void editorPutBuffer(abuf *ab);
 
 void editorRefreshScreen();
 
+void vtAppend(vtbuf *b, const char *s, int len);
+
+const unsigned char *vtRgb(int color, int bg);
+
+void vtSgr(int color, int plain);
+
+int vtWidth(const char *s, int len);
+
+void vtMove(int y, int x);
+
+void vtPut(const char *s, const unsigned char *c, int len);
+
+void vtDrawLine(int y, const char *s, const unsigned char *c, int len);
+
+unsigned int vtHash(const char *s, const unsigned char *c, int len);
+
+void vtScroll(const unsigned int *hash, int rows);
+
+void vtFlush(abuf *ab);
+
 void editorSetStatusMsg(const char *fmt, ...);
 
-void editorRowInsertChar(erow *row, int at, int c);
+void editorRowInsertChar(int at, int col, int c);
+
+void editorRowAppendString(int at, char *s, size_t len);
 
 void editorInsertChar(int isundoredo, int c);
 
 void editorInsertNewline();
 
-void editorRowDelChar(erow *row, int at);
+void editorRowDelChar(int at, int col);
 
 void editorDelChar(int isundoredo);
 
@@ -116,853 +573,5698 @@ int isPrintable(int c);
 
 void editorMoveCursor(int c);
 
-void editorProcessKeypress();
+void editorProcessKeypress(int c);
 
 void getWindowSize(int *rows, int *cols);
 
 void editorUpdateSyntax(erow *row);
 
+erow *editorRowSyntax(int at);
+
 void initEditor();
 
 void editorUpdateRow(erow *row);
 
+void editorRowChanged(int at);
+
 void editorInsertRow(int at, char *s, size_t len);
 
 void editorFreeRow(erow *row);
 
 void editorDelRow(int at);
 
-char *editorRowsToStr(int *buflen);
+int coldCompress(const char *src, int len, char *dst);
 
-void editorOpen(char *filename);
+int coldDecompress(const char *src, int clen, char *dst, int len);
 
-void editorSave();
+const char *coldBlockDataInto(coldblock *blk, coldblock **cacheblk, char **cachebuf);
 
-void editorFindCallback(char *query, int key);
+const char *coldBlockData(coldblock *blk);
 
-void editorFind();
+void coldBlockRelease(coldblock *blk);
 
-void undo_push(undo_stack *u, redo_stack *r, int ch, int ins, int isredo);
+void editorFreezeRows(int from, int to);
 
-void redo_push(undo_stack *u, redo_stack *r, int ch, int ins, int isundo);
+void editorRowThaw(erow *row);
 
-int isemptyu(undo_stack *u);
+erow *editorRowAt(int at);
 
-int isemptyr(redo_stack *r);
+const char *editorRowPeek(int at, int *len);
 
-int undo_pop(undo_stack *u, redo_stack *r);
+void editorColdTick();
 
-int redo_pop(undo_stack *u, redo_stack *r);
+void editorColdSweep(int start, int end, int force);
 
-void undo(undo_stack *u, redo_stack *r);
+void fenwickFree(fenwick *f);
 
-void redo(undo_stack *u, redo_stack *r);
+void fenwickReindex(fenwick *f);
 
-void undo_push(undo_stack *u, redo_stack *r, int ch, int ins, int isredo) {
-	stack *nn = malloc(sizeof(stack));
-	nn->ch = ch;
-	if(isredo) {
-		nn->cx = r->top->cx;
-		nn->cy = r->top->cy;
-	}
-	else {
-		nn->cx = E.cx;
-		nn->cy = E.cy;
-	}
-	nn->ins = ins;
-	nn->next = u->top;
-	u->top = nn;
-}
+void fenwickBuild(fenwick *f, int n, int (*value)(int));
 
-void redo_push(undo_stack *u, redo_stack *r, int ch, int ins, int isundo) {
-	stack *nn = malloc(sizeof(stack));
-	nn->ch = ch;
-	if(isundo) {
-		nn->cx = u->top->cx;
-		nn->cy = u->top->cy;
-	}
-	else {
-		nn->cx = E.cx;
-		nn->cy = E.cy;
-	}
-	nn->ins = ins;
-	nn->next = r->top;
-	r->top = nn;
-}
+int fenwickLocate(fenwick *f, int i, int *off);
 
-int isemptyu(undo_stack *u) {
-	return (u->top == NULL);
-}
+int fenwickGet(fenwick *f, int i);
 
-int isemptyr(redo_stack *r) {
-	return (r->top == NULL);
-}
+void fenwickSet(fenwick *f, int i, int v);
 
-int undo_pop(undo_stack *u, redo_stack *r) {
-	stack *p = u->top;
-	int c = p->ch;
-	if(p->ins == 1)
-		redo_push(u, r, c, 0, 1);
-	else
-		redo_push(u, r, c, 1, 1);
-	u->top = p->next;
-	free(p);
-	return c;
-}
+void fenwickInsert(fenwick *f, int i, int v);
 
-int redo_pop(undo_stack *u, redo_stack *r) {
-	stack *p = r->top;
-	int c = p->ch;
-	if(p->ins == 1)
-		undo_push(u, r, c, 0, 1);
-	else
-		undo_push(u, r, c, 1, 1);
-	r->top = p->next;
-	free(p);
-	return c;
-}
+void fenwickDelete(fenwick *f, int i);
 
-void undo(undo_stack *u, redo_stack *r) {
-	if(!isemptyu(u)) {
-		E.cx = u->top->cx;
-		E.cy = u->top->cy;
-		if(u->top->ins == 1) {
-			if(u->top->ch == '\n') {
-				editorInsertNewline(0);
-				undo_pop(u, r);
-				return;
-			}
-			editorInsertChar(0, undo_pop(u, r));
-		}
-		else {
-			editorDelChar(0);
-			undo_pop(u, r);
-		}
-	}
-}
+long long fenwickPrefix(fenwick *f, int i);
 
-void redo(undo_stack *u, redo_stack *r) {
-	if(!isemptyr(r)) {
-		E.cx = r->top->cx;
-		E.cy = r->top->cy;
-		if(r->top->ins == 1) {
-			if(r->top->ch == '\n') {
-				editorInsertNewline(0);
-				redo_pop(u, r);
-				return;
-			}
-			editorInsertChar(0, redo_pop(u, r));
-		}
-		else {
-			editorDelChar(0);
-			redo_pop(u, r);
-		}
-	}
-}
+int fenwickFind(fenwick *f, long long off);
 
-void die(const char *s) {
-	perror(s);
-	exit(1);
-}
+snapshot *snapshotCapture();
 
-void abAppend(abuf *ab, const char *s, int len) {
-	char *new = realloc(ab->b, ab->len + len);
+void snapshotRelease(snapshot *s);
 
-	if(new == NULL) return;
-	memcpy(&new[ab->len], s, len);
-	ab->b = new;
-	ab->len += len;
-}
+long long snapshotWrite(snapshot *s, int fd);
 
-void abFree(abuf *ab) {
-	free(ab->b);
-}
+int rowtableLocate(rowtable *t, int at, int *off);
 
-int editorRowCxToRx(erow *row, int cx) {
-	int rx = 0;
-	for(int j = 0; j < cx; j++) {
-		if(row->chars[j] == '\t')
-			rx += (TAB_STOP - 1) - (rx % TAB_STOP);
-		rx++;
-	}
-	return rx;
-}
+erow *rowtableAt(rowtable *t, int at);
 
-int editorRowRxToCx(erow *row, int rx) {
-	int cur_rx = 0;
-	int cx;
-	for(cx = 0; cx < row->size; cx++) {
-		if(row->chars[cx] == '\t')
-			cur_rx += (TAB_STOP - 1) - (cur_rx % TAB_STOP);
-		cur_rx++;
-		if(cur_rx > rx) return cx;
-	}
-	return cx;
-}
+void rowtableResize(rowtable *t, int numchunks);
 
-void editorScroll() {
-	E.rx = 0;
-	if(E.cy < E.numrows) {
-		E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
-	}
-	if(E.cy < E.rowoff) {
-		E.rowoff = E.cy;
-	}
-	if(E.cy >= E.rowoff + E.rows) {
-		E.rowoff = E.cy - E.rows + 1;
-	}
-	if(E.rx < E.coloff) {
-		E.coloff = E.rx;
-	}
-	if(E.rx >= E.coloff + E.cols) {
-		E.coloff = E.rx - E.cols + 1;
-	}
-}
+void rowtableRenumber(rowtable *t, int from);
 
-void editorCharToChtype(abuf *ab) {
-	int len = ab->len;
-	len += 1;
-}
+void rowtableFree(rowtable *t);
 
-void editorDrawRows(abuf *ab) {
-	for(int i = 0; i < E.rows; i++) {
-		int filerow = i + E.rowoff;
-		if(filerow >= E.numrows) {
-			if(!E.dirty) {
-				if(E.numrows == 0 && i == E.rows / 3) {
-					char welcome[80];
-					int welcomelen = snprintf(welcome, sizeof(welcome), "Text editor");
-					if(welcomelen > E.cols) welcomelen = E.cols;
-					int padding = (E.cols - welcomelen) / 2;
-					if(padding) {
-						abAppend(ab, "~", 1);
-						padding--;
-					}
-					while(padding--) abAppend(ab, " ", 1);
-					abAppend(ab, welcome, welcomelen);
-				}
-				else {
-					abAppend(ab, "~", 1);
-				}
-			}
-			else {
-				abAppend(ab, " ", 1);
-			}
-		}
-		else {
-			E.line_width = (int)log10(E.numrows) + 1;
-			int line_number = filerow + 1;
-			char line_number_str[E.line_width + 1];
-			snprintf(line_number_str, sizeof(line_number_str), "%*d ", E.line_width, line_number);
-			abAppend(ab, line_number_str, strlen(line_number_str));
-			abAppend(ab, " ", 1);
-			int len = E.row[filerow].rsize - E.coloff;
-			if(len < 0) len = 0;
-			if(len >= E.cols) len = E.cols - E.line_width - 2;
-			abAppend(ab, &E.row[filerow].render[E.coloff], len);
-		}
-		abAppend(ab, "\n", 1);
-	}
-	abAppend(ab, "", 1);
-}
+rowchunk *editorChunkNew();
 
-void editorDrawStatusBar() {
-	char status[80], rstatus[80];
-	int len = snprintf(status, sizeof(status), "%s - %d lines %s", E.filename ? E.filename : "[No Name]", E.numrows, E.dirty ? "(modified)" : "");
-	int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d", E.cy + 1, E.numrows);
-	if(len > E.cols) len = E.cols;
-	attron(COLOR_PAIR(1));
-	clrtoeol();
-	for(int i = 0; i < len; i++) {
-		addch(status[i]);
-	}
-	while(len < E.cols) {
-		if(E.cols - len - 1 == rlen) {
-			for(int i = 0; i < rlen; i++)
-				addch(rstatus[i]);
-			break;
-		}
-		else
-			addch(' ');
-		len++;
-	}
-	addch('\n');
-	attroff(COLOR_PAIR(1));
-}
+void editorChunkFree(rowchunk *chunk);
 
-void editorDrawMsgBar() {
-	if(strlen(E.statusmsg) && time(NULL) - E.statusmsg_time < 3) {
-		clrtoeol();
-		addstr(E.statusmsg);
-	}
-	else
-		clrtoeol();
-}
+rowchunk *editorChunkOwn(int c);
 
-#define MAX_LINE_LENGTH 1024
+void editorChunkRemove(int c, int count);
 
-const char *keywords[] = {
-    "auto", "break", "case", "char", "const", "continue", "default", "do", "double",
-    "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register",
-    "restrict", "return", "short", "signed", "sizeof", "static", "struct", "switch", "typedef",
-    "union", "unsigned", "void", "volatile", "while"
-};
+erow *editorRow(int at);
 
-#define NUM_KEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+erow *editorRowUnshare(int at);
 
-int is_keyword(const char *word) {
-    for(long unsigned int i = 0; i < NUM_KEYWORDS; i++) {
-        if(strcmp(word, keywords[i]) == 0) {
-            return 1;
-        }
-    }
-    return 0;
-}
+int editorRowsSplit(int at);
 
-void highlight_buffer(const char *buffer) {
-	char word[MAX_LINE_LENGTH];
-	int word_len = 0;
-	int in_string = 0;
-	int in_comment = 0;
+void editorRowsMerge(int c);
 
-	for(int i = 0; buffer[i] != '\0'; i++) {
-		char ch = buffer[i];
-		if(in_comment) {
-			attron(COLOR_PAIR(4));
-			printw("%c", ch);
-			if(ch == '\n') {
-				in_comment = 0;
-			}
-			attroff(4);
-		}
-		else if(in_string) {
-			attron(COLOR_PAIR(3));
-			printw("%c", ch);
-			if(ch == '"') {
-				in_string = 0;
-			}
-			attroff(3);
-		}
-		else if(ch == '"') {
-			in_string = 1;
-			attron(COLOR_PAIR(3));
-			printw("%c", ch);
-			attroff(3);
-		}
-		else if(ch == '/' && buffer[i + 1] == '/') {
-			in_comment = 1;
-			attron(COLOR_PAIR(4));
-			printw("%c%c", ch, buffer[i + 1]);
-			i++;
-			attroff(4);
-		}
-		else if(isspace(ch) || ispunct(ch)) {
-			attron(COLOR_PAIR(5));
-			printw("%c", ch);
-			attroff(5);
-		}
-		else if(isdigit(ch)) {
-			attron(COLOR_PAIR(6));
-			printw("%c", ch);
-			attroff(6);
-		}
-		else {
-			word[word_len++] = ch;
-			if(!isalnum(buffer[i + 1])) {
-				word[word_len] = '\0';
-				if(is_keyword(word)) {
-					attron(COLOR_PAIR(2));
-					printw("%s", word);
-					attroff(2);
-				}
+void editorRowsSplice(int at, int del, erow *rows, int ins);
+
+void editorRowsFree();
+
+erow *editorRowWrite(int at);
+
+void editorGrave(void *ptr, int kind, int birth);
+
+void editorGraveSweep();
+
+void *editorSaveThread(void *arg);
+
+void editorSaveStart(int manual);
+
+void editorSaveTick();
+
+void editorSaveFlush();
+
+char *editorAutosavePath(const char *filename);
+
+int editorRowBytes(int at);
+
+fenwick *editorByteIndex();
+
+int editorWrapWidth();
+
+erow *editorRowMeasure(int at);
+
+int editorWrapWalk(int at, int stoprx, int stopseg, int *segrx);
+
+int editorRowVisual(int at);
+
+fenwick *editorWrapIndex();
+
+int editorWrapSeg(int at, int rx, int *segrx);
+
+int editorWrapSegStart(int at, int seg);
+
+long long editorWrapTop();
+
+void editorWrapScroll(long long top);
+
+void editorWrapCursor(long long v, int x);
+
+int editorScreenPos(int at, int rx, int *y, int *x);
+
+void editorDrawWrapped(abuf *ab);
+
+void editorGoto();
+
+int editorIsWordChar(int c);
+
+int editorWordCmp(const char *a, int alen, const char *b, int blen);
+
+int editorIndexCmp(const void *a, const void *b);
+
+int editorIndexToken(const char *word, int len, int create);
+
+void editorIndexResolve(wordtok *t);
+
+void editorIndexRow(int at, int delta);
+
+void editorIndexLog(int at, int n);
+
+void editorIndexRowChanged(int at);
+
+void editorIndexRowInserted(int at);
+
+void editorIndexRowDeleted(int at);
+
+void editorIndexReset();
+
+int editorIndexTick(long long deadline);
+
+void editorIndexSort();
+
+int editorIndexLowerBound(const char *word, int len, int n);
+
+int editorRowFindWord(int at, const char *word, int len);
+
+int editorIndexOccurrence(int id, int after, int *cx);
+
+int editorIntCmp(const void *a, const void *b);
+
+void editorComplete();
+
+int editorFuzzyScore(const char *word, int len, const char *query);
+
+void editorJumpCallback(char *query, int key);
+
+void editorJump();
+
+int bracketRowScan(int at, int *state);
+
+void bracketCombine(bracketsum *out, bracketsum *l, bracketsum *r);
+
+void bracketLeaf(int leaf, int start);
+
+void bracketPull(int leaf);
+
+void bracketBuildNodes(int numleaves);
+
+int bracketBuild(long long deadline);
+
+int bracketLeafOf(int row, int *start);
+
+void bracketRowInserted(int at);
+
+void bracketRowDeleted(int at);
+
+void bracketRowChanged(int at);
+
+void bracketPrefix(int row, int *state, int *depth);
+
+int bracketFindBack(int i, int l, int r, int k, int st, int d, int *rows, int target);
+
+int bracketFindForward(int i, int l, int r, int k, int *st, int *d, int *rows, int target);
+
+int bracketScanBack(int from, int to, int col, int st, int d, int target, int *orow, int *ocol);
+
+int bracketBackward(int row, int col, int target, int *orow, int *ocol);
+
+int bracketScanForward(int from, int to, int row, int col, int st, int d, int target, int *orow, int *ocol);
+
+int bracketForward(int row, int col, int target, int *orow, int *ocol);
+
+int bracketDepthAt(int row, int col);
+
+brackettree *editorBrackets();
+
+void editorMatchBracket();
+
+void editorHlCells(abuf *ab, int start, int end, int col, int n, unsigned char color);
+
+void editorDrawBlock(abuf *ab);
+
+unsigned int diffHash(const char *s, int len);
+
+unsigned int diffRowHash(int at);
+
+void diffTouch(int lo, int hi);
+
+void diffRowChanged(int at);
+
+void diffRowInserted(int at);
+
+void diffRowDeleted(int at);
+
+void diffMark(int at, int mark, int disk);
+
+void diffBaseline(snapshot *base, const char *path, int plain);
+
+void diffGreedy(const unsigned int *a, int n, const unsigned int *b, int m, char *da, char *db);
+
+void diffBisect(const unsigned int *a, int n, const unsigned int *b, int m, char *da, char *db);
+
+void diffCompare(const unsigned int *a, int n, const unsigned int *b, int m, char *da, char *db);
+
+void diffUpdate();
+
+int diffTick(long long deadline);
+
+void diffToggle();
+
+void diffJump(int dir);
+
+unsigned long long sessionHash(const unsigned char *s, long long len);
+
+unsigned char *sessionPutVarint(unsigned char *p, unsigned long long v);
+
+const unsigned char *sessionGetVarint(const unsigned char *p, const unsigned char *end, unsigned long long *v);
+
+char *sessionPath(const char *filename, char **real, int create);
+
+int *sessionScan(int fd, struct stat *st, int *numrows, unsigned int **hashes);
+
+unsigned char *sessionEncode(const char *real, int fd, struct stat *st, long long *buflen);
+
+int sessionDecode(const unsigned char *buf, long long len, const char *real, int fd, struct stat *st);
+
+int sessionLoad(const char *filename, int fd, struct stat *st);
+
+void sessionSave();
+
+void filterAddRow(filterjob *f, const char *s, int len);
+
+int filterWrite(filterjob *f);
+
+int filterRead(filterjob *f);
+
+void filterReadErr(filterjob *f);
+
+int filterStart(filterjob *f, const char *cmd);
+
+void editorToggleMark();
+
+void editorFilter();
+
+void filterRun(const char *cmd, int from, int to);
+
+int editorRenderTabs(const char *s, int len, int ascii, int col, char *out);
+
+void pagerOpen(char *filename);
+
+void pagerAttach();
+
+void *pagerIndexThread(void *arg);
+
+const char *pagerWindow(long long off, long long need, long long *avail);
+
+long long pagerNextLine(long long off);
+
+long long pagerLineStart(long long off);
+
+long long pagerLineNumber(long long off);
+
+long long pagerLineOffset(long long line);
+
+int pagerColumnByte(const char *s, int len, int ascii, int coloff, int *col);
+
+void pagerDrawRows(abuf *ab);
+
+void pagerDrawStatus(char *status, int *len, char *rstatus, int *rlen);
+
+void pagerScroll(int lines);
+
+long long pagerSearch(const char *query, long long from, int direction);
+
+void pagerFindCallback(char *query, int key);
+
+void pagerFind();
+
+void pagerGoto();
+
+void pagerProcessKeypress(int c);
+
+long long editorNow();
+
+int editorIdleRows(long long deadline);
+
+void editorIdle();
+
+char *editorRowsToStr(long long *buflen);
+
+void editorOpen(char *filename);
+
+void editorSave();
+
+void editorFindCallback(char *query, int key);
+
+void editorFind();
+
+undonode *editorUndoRecord(int kind, int ch, int cx, int cy);
+
+int editorUndoSeqCmp(const void *a, const void *b);
+
+void editorUndoCheckpoint(undonode *n);
+
+int editorUndoLen(undonode *n);
+
+void editorUndoApply(undonode *n, int forward);
+
+void editorUndoRestore(undonode *n);
+
+void editorUndoSwap(undonode *n);
+
+int editorUndoBulkBetween(undonode *a, undonode *b);
+
+void editorRowsReplaced();
+
+void editorUndoGoto(undonode *target);
+
+void editorUndo();
+
+void editorRedo();
+
+undonode *editorUndoFind(const char *spec);
+
+int editorUndoMerge(undonode *p, time_t cutoff);
+
+int editorUndoCompact(long long deadline);
+
+void editorUndoFreeNode(undonode *n);
+
+void editorUndoDropChecks();
+
+int editorUndoTrim();
+
+void editorUndoClear();
+
+void editorRevision();
+
+undonode *editorUndoRecord(int kind, int ch, int cx, int cy) {
+	undotree *u = &E.undo;
+	if(u->cur == NULL && kind != UNDO_ROOT)
+		editorUndoRecord(UNDO_ROOT, 0, cx, cy);
+	if(u->nodes == NULL || u->numnodes % 256 == 0)
+		u->nodes = memRealloc(MEM_UNDO, u->nodes, sizeof(undonode *) * (u->numnodes + 256));
+	undonode *n = memAlloc(MEM_UNDO, sizeof(undonode));
+	n->kind = kind;
+	n->ch = ch;
+	n->text = NULL;
+	n->len = 0;
+	n->cx = cx;
+	n->cy = cy;
+	n->seq = u->numnodes;
+	n->time = time(NULL);
+	n->check = NULL;
+	n->rows = NULL;
+	n->numrows = 0;
+	n->parent = u->cur;
+	n->child = NULL;
+	n->children = NULL;
+	n->sibling = NULL;
+	n->depth = 0;
+	u->nodes[u->numnodes++] = n;
+	if(u->cur) {
+		if(u->cur->depth % UNDO_CHECK_EDITS == 0 && !u->cur->check)
+			editorUndoCheckpoint(u->cur);
+		n->depth = u->cur->depth + 1;
+		n->sibling = u->cur->children;
+		u->cur->children = n;
+		u->cur->child = n;
+	}
+	else {
+		u->root = n;
+	}
+	u->cur = n;
+	return n;
+}
+
+int editorUndoSeqCmp(const void *a, const void *b) {
+	return (*(undonode **)a)->seq - (*(undonode **)b)->seq;
+}
+
+void editorUndoCheckpoint(undonode *n) {
+	undotree *u = &E.undo;
+	int max = UNDO_CHECK_BYTES / (sizeof(erow) * (E.numrows + 1));
+	if(max > UNDO_MAX_CHECKS) max = UNDO_MAX_CHECKS;
+	if(max < 2) max = 2;
+	while(u->numchecks >= max) {
+		qsort(u->checks, u->numchecks, sizeof(undonode *), editorUndoSeqCmp);
+		int drop = u->numchecks - 1, gap = -1;
+		for(int i = 1; i < u->numchecks - 1; i++) {
+			int g = u->checks[i + 1]->seq - u->checks[i - 1]->seq;
+			if(gap == -1 || g < gap) {
+				drop = i;
+				gap = g;
+			}
+		}
+		snapshotRelease(u->checks[drop]->check);
+		u->checks[drop]->check = NULL;
+		memmove(&u->checks[drop], &u->checks[drop + 1], sizeof(undonode *) * (u->numchecks - drop - 1));
+		u->numchecks--;
+	}
+	if(u->checks == NULL)
+		u->checks = memAlloc(MEM_UNDO, sizeof(undonode *) * UNDO_MAX_CHECKS);
+	n->check = snapshotCapture();
+	u->checks[u->numchecks++] = n;
+}
+
+int editorUndoLen(undonode *n) {
+	char seq[4];
+	return n->text ? n->len : utf8Encode(n->ch, seq);
+}
+
+void editorUndoApply(undonode *n, int forward) {
+	if(n->kind == UNDO_BULK) {
+		editorUndoSwap(n);
+		return;
+	}
+	int insert = (n->kind == UNDO_INSERT) == forward;
+	if(insert) {
+		E.cx = n->cx;
+		E.cy = n->cy;
+		if(n->text) {
+			int cp;
+			for(int i = 0; i < n->len; ) {
+				i += utf8Decode(&n->text[i], n->len - i, &cp);
+				editorInsertChar(0, cp);
+			}
+		}
+		else if(n->ch == '\n')
+			editorInsertNewline(0);
+		else
+			editorInsertChar(0, n->ch);
+	}
+	else if(n->text) {
+		E.cx = n->cx + n->len;
+		E.cy = n->cy;
+		while(E.cx > n->cx)
+			editorDelChar(0);
+	}
+	else {
+		if(n->ch == '\n' && n->cy + 1 == E.numrows && editorRow(n->cy)->size == 0) {
+			editorDelRow(n->cy);
+			E.cx = 0;
+			E.cy = n->cy;
+			return;
+		}
+		if(n->ch == '\n') {
+			E.cx = 0;
+			E.cy = n->cy + 1;
+		}
+		else {
+			E.cx = n->cx + editorUndoLen(n);
+			E.cy = n->cy;
+		}
+		editorDelChar(0);
+	}
+}
+
+void editorUndoRestore(undonode *n) {
+	snapshot *s = n->check;
+	int size = 16;
+	while(size < 2 * s->numrows) size *= 2;
+	char **set = calloc(size, sizeof(char *));
+	for(int i = 0; i < s->numrows; i++) {
+		erow *row = rowtableAt(&s->row, i);
+		if(row->cold) {
+			row->cold->refs++;
+			continue;
+		}
+		unsigned int h = ((uintptr_t)row->chars >> 4) * 2654435761u;
+		while(set[h & (size - 1)]) h++;
+		set[h & (size - 1)] = row->chars;
+	}
+
+	for(int i = 0; i < E.numrows; i++) {
+		erow *row = editorRow(i);
+		int kept = 0;
+		if(!row->cold) {
+			unsigned int h = ((uintptr_t)row->chars >> 4) * 2654435761u;
+			while(set[h & (size - 1)] && set[h & (size - 1)] != row->chars) h++;
+			kept = set[h & (size - 1)] != NULL;
+		}
+		if(kept) {
+			memFree(MEM_RENDER, row->render);
+			memFree(MEM_RENDER, row->hl);
+		}
+		else
+			editorFreeRow(row);
+	}
+	int kept = 0;
+	for(int i = 0; i < E.numgraves; i++) {
+		grave *g = &E.graves[i];
+		int found = 0;
+		if(g->kind == GRAVE_TEXT) {
+			unsigned int h = ((uintptr_t)g->ptr >> 4) * 2654435761u;
+			while(set[h & (size - 1)] && set[h & (size - 1)] != g->ptr) h++;
+			found = set[h & (size - 1)] != NULL;
+		}
+		if(!found) E.graves[kept++] = *g;
+	}
+	E.numgraves = kept;
+	free(set);
+
+	editorRowsFree();
+	rowtableResize(&E.row, s->row.numchunks);
+	for(int c = 0; c < s->row.numchunks; c++) {
+		rowchunk *chunk = editorChunkNew();
+		chunk->n = s->row.chunk[c]->n;
+		memcpy(chunk->row, s->row.chunk[c]->row, sizeof(erow) * chunk->n);
+		for(int k = 0; k < chunk->n; k++) {
+			chunk->row[k].render = NULL;
+			chunk->row[k].hl = NULL;
+		}
+		E.row.chunk[c] = chunk;
+		E.row.start[c] = s->row.start[c];
+	}
+	E.row.numchunks = s->row.numchunks;
+	E.numrows = s->numrows;
+	editorRowsReplaced();
+}
+
+void editorUndoSwap(undonode *n) {
+	int take = n->len, put = n->numrows;
+	erow *taken = memAlloc(MEM_UNDO, sizeof(erow) * (take + 1));
+	for(int i = 0; i < take; i++) {
+		taken[i] = *editorRow(n->cy + i);
+		if(!taken[i].cold) {
+			memFree(MEM_RENDER, taken[i].render);
+			memFree(MEM_RENDER, taken[i].hl);
+		}
+		taken[i].render = NULL;
+		taken[i].hl = NULL;
+	}
+	editorRowsSplice(n->cy, take, n->rows, put);
+	E.numrows += put - take;
+	if(E.mark >= n->cy + take) E.mark += put - take;
+	else if(E.mark >= n->cy + put) E.mark = n->cy + put - 1;
+	memFree(MEM_UNDO, n->rows);
+	n->rows = taken;
+	n->numrows = take;
+	n->len = put;
+	E.cy = n->cy;
+	E.cx = 0;
+	editorRowsReplaced();
+}
+
+int editorUndoBulkBetween(undonode *a, undonode *b) {
+	while(a != b) {
+		undonode **up = a->depth >= b->depth ? &a : &b;
+		if((*up)->kind == UNDO_BULK) return 1;
+		*up = (*up)->parent;
+	}
+	return 0;
+}
+
+void editorRowsReplaced() {
+	if(E.mark >= E.numrows) E.mark = E.numrows - 1;
+	E.bytes.valid = 0;
+	E.wrap.valid = 0;
+	E.dirty++;
+	E.brackets.valid = 0;
+	E.brackets.building = 0;
+	diffTouch(0, E.numrows - 1);
+	editorIndexReset();
+}
+
+void editorUndoGoto(undonode *target) {
+	undotree *u = &E.undo;
+	undonode *a = u->cur, *b = target;
+	int walk = 0;
+	while(a != b) {
+		if(a->depth >= b->depth)
+			a = a->parent;
+		else
+			b = b->parent;
+		walk++;
+	}
+	undonode *from = a;
+	undonode *c = target;
+	int steps = 0;
+	while(c && !c->check && steps < walk) {
+		c = c->parent;
+		steps++;
+	}
+
+	if(c && c->check && steps < walk && !editorUndoBulkBetween(u->cur, c)) {
+		editorUndoRestore(c);
+		from = c;
+	}
+	else {
+		while(u->cur != from) {
+			editorUndoApply(u->cur, 0);
+			u->cur = u->cur->parent;
+		}
+	}
+
+	int n = 0;
+	for(b = target; b != from; b = b->parent)
+		n++;
+	undonode **path = malloc(sizeof(undonode *) * (n + 1));
+	b = target;
+	for(int i = n; i > 0; i--) {
+		path[i - 1] = b;
+		b->parent->child = b;
+		b = b->parent;
+	}
+	for(int i = 0; i < n; i++)
+		editorUndoApply(path[i], 1);
+	free(path);
+	u->cur = target;
+	if(target->kind == UNDO_INSERT && !target->text && target->ch == '\n') {
+		E.cx = 0;
+		E.cy = target->cy + 1;
+	}
+	else if(target->kind != UNDO_ROOT) {
+		E.cx = target->cx + (target->kind == UNDO_INSERT ? editorUndoLen(target) : 0);
+		E.cy = target->cy;
+	}
+	if(E.cy > E.numrows) {
+		E.cy = E.numrows;
+		E.cx = 0;
+	}
+}
+
+void editorUndo() {
+	undonode *n = E.undo.cur;
+	if(n == NULL || n->parent == NULL) return;
+	editorUndoApply(n, 0);
+	E.undo.cur = n->parent;
+}
+
+void editorRedo() {
+	undonode *n = E.undo.cur ? E.undo.cur->child : NULL;
+	if(n == NULL) return;
+	editorUndoApply(n, 1);
+	E.undo.cur = n;
+}
+
+undonode *editorUndoFind(const char *spec) {
+	undotree *u = &E.undo;
+	const char *num = spec[0] == '-' ? spec + 1 : spec;
+	char *end;
+	long v = strtol(num, &end, 10);
+	if(end == num || v < 0) return NULL;
+	undonode *n;
+	if(spec[0] != '-') {
+		if(v >= u->numnodes) return NULL;
+		for(n = u->nodes[v]; n->kind == UNDO_MERGED; n = n->parent);
+		return n;
+	}
+
+	if(*end == 'h') v *= 3600;
+	else if(*end == 'm' || *end == '\0') v *= 60;
+	else if(*end != 's') return NULL;
+	time_t when = time(NULL) - v;
+	int lo = 0, hi = u->numnodes - 1;
+	while(lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if(u->nodes[mid]->time <= when) lo = mid;
+		else hi = mid - 1;
+	}
+	for(n = u->nodes[lo]; n->kind == UNDO_MERGED; n = n->parent);
+	return n;
+}
+
+int editorUndoMerge(undonode *p, time_t cutoff) {
+	undotree *u = &E.undo;
+	undonode *c = p->children;
+	if(p->kind != UNDO_INSERT && p->kind != UNDO_DELETE) return 0;
+	if(c == NULL || c->sibling || c->kind != p->kind || c->time > cutoff) return 0;
+	if(p == u->cur || c == u->cur || p->check || c->check) return 0;
+	if((!p->text && p->ch == '\n') || (!c->text && c->ch == '\n') || c->cy != p->cy) return 0;
+	int plen = editorUndoLen(p), clen = editorUndoLen(c), prepend;
+	if(p->kind == UNDO_INSERT && c->cx == p->cx + plen)
+		prepend = 0;
+	else if(p->kind == UNDO_DELETE && c->cx == p->cx)
+		prepend = 0;
+	else if(p->kind == UNDO_DELETE && c->cx + clen == p->cx)
+		prepend = 1;
+	else
+		return 0;
+
+	char cseq[4];
+	const char *ctext = c->text;
+	if(!ctext) {
+		utf8Encode(c->ch, cseq);
+		ctext = cseq;
+	}
+	if(!p->text) {
+		p->text = memAlloc(MEM_UNDO, 4);
+		utf8Encode(p->ch, p->text);
+	}
+	p->text = memRealloc(MEM_UNDO, p->text, plen + clen);
+	if(prepend) {
+		memmove(&p->text[clen], p->text, plen);
+		p->cx = c->cx;
+	}
+	memcpy(&p->text[prepend ? 0 : plen], ctext, clen);
+	p->len = plen + clen;
+	p->time = c->time;
+	p->children = c->children;
+	p->child = c->child;
+	for(undonode *k = c->children; k; k = k->sibling)
+		k->parent = p;
+	memFree(MEM_UNDO, c->text);
+	c->text = NULL;
+	c->kind = UNDO_MERGED;
+	c->parent = p;
+	c->children = c->child = c->sibling = NULL;
+	return 1;
+}
+
+int editorUndoCompact(long long deadline) {
+	undotree *u = &E.undo;
+	time_t cutoff = time(NULL) - UNDO_COMPACT_SECS;
+	if(u->compacted >= u->numnodes || u->nodes[u->compacted]->time > cutoff) return 0;
+	while(u->compacted < u->numnodes && u->nodes[u->compacted]->time <= cutoff) {
+		while(editorUndoMerge(u->nodes[u->compacted], cutoff))
+			if(editorNow() >= deadline) return 1;
+		u->compacted++;
+		if(editorNow() >= deadline) break;
+	}
+	return 1;
+}
+
+void editorUndoFreeNode(undonode *n) {
+	memFree(MEM_UNDO, n->text);
+	for(int i = 0; i < n->numrows; i++)
+		editorFreeRow(&n->rows[i]);
+	memFree(MEM_UNDO, n->rows);
+	memFree(MEM_UNDO, n);
+}
+
+void editorUndoDropChecks() {
+	undotree *u = &E.undo;
+	for(int i = 0; i < u->numchecks; i++) {
+		snapshotRelease(u->checks[i]->check);
+		u->checks[i]->check = NULL;
+	}
+	u->numchecks = 0;
+}
+
+int editorUndoTrim() {
+	undotree *u = &E.undo;
+	if(u->cur == NULL || u->cur->depth <= UNDO_KEEP_MIN) return 0;
+	editorUndoDropChecks();
+	int depth = u->cur->depth - u->cur->depth / 2;
+	if(depth < UNDO_KEEP_MIN) depth = UNDO_KEEP_MIN;
+	undonode *r = u->cur;
+	while(r->depth > u->cur->depth - depth)
+		r = r->parent;
+	int base = r->depth;
+	char *keep = malloc(u->numnodes);
+	for(int i = 0; i < u->numnodes; i++) {
+		undonode *n = u->nodes[i];
+		keep[i] = n == r || (n->parent && keep[n->parent->seq]);
+	}
+	int kept = 0;
+	for(int i = 0; i < u->numnodes; i++) {
+		undonode *n = u->nodes[i];
+		if(!keep[i]) {
+			editorUndoFreeNode(n);
+			continue;
+		}
+		n->seq = kept;
+		n->depth -= base;
+		u->nodes[kept++] = n;
+	}
+	free(keep);
+	u->numnodes = kept;
+	u->nodes = memRealloc(MEM_UNDO, u->nodes, sizeof(undonode *) * (kept / 256 + 1) * 256);
+	u->compacted = 0;
+
+	memFree(MEM_UNDO, r->text);
+	for(int i = 0; i < r->numrows; i++)
+		editorFreeRow(&r->rows[i]);
+	memFree(MEM_UNDO, r->rows);
+	r->kind = UNDO_ROOT;
+	r->text = NULL;
+	r->len = 0;
+	r->rows = NULL;
+	r->numrows = 0;
+	r->parent = NULL;
+	r->sibling = NULL;
+	u->root = r;
+	return 1;
+}
+
+void editorUndoClear() {
+	undotree *u = &E.undo;
+	editorUndoDropChecks();
+	for(int i = 0; i < u->numnodes; i++)
+		editorUndoFreeNode(u->nodes[i]);
+	memFree(MEM_UNDO, u->nodes);
+	memFree(MEM_UNDO, u->checks);
+	u->root = u->cur = NULL;
+	u->nodes = u->checks = NULL;
+	u->numnodes = 0;
+	u->compacted = 0;
+}
+
+void editorRevision() {
+	if(E.undo.root == NULL) {
+		editorSetStatusMsg("No revisions yet");
+		return;
+	}
+	char *spec = editorPrompt("Revision (number, -Nm or -Ns ago): %s", NULL);
+	if(spec == NULL) return;
+	undonode *n = editorUndoFind(spec);
+	free(spec);
+	if(n == NULL) {
+		editorSetStatusMsg("No such revision");
+		return;
+	}
+	editorUndoGoto(n);
+	editorSetStatusMsg("Revision %d of %d, %lds ago", n->seq, E.undo.numnodes - 1, (long)(time(NULL) - n->time));
+}
+
+void die(const char *s) {
+	perror(s);
+	exit(1);
+}
+
+void *memAlloc(int tag, size_t size) {
+	void *p = malloc(size);
+	E.mem.used[tag] += malloc_usable_size(p);
+	return p;
+}
+
+void *memRealloc(int tag, void *ptr, size_t size) {
+	size_t old = malloc_usable_size(ptr);
+	void *p = realloc(ptr, size);
+	if(p == NULL && size) return NULL;
+	E.mem.used[tag] += (long long)malloc_usable_size(p) - (long long)old;
+	return p;
+}
+
+void memFree(int tag, void *ptr) {
+	E.mem.used[tag] -= malloc_usable_size(ptr);
+	free(ptr);
+}
+
+long long memTotal() {
+	long long total = 0;
+	for(int t = 0; t < MEM_TAGS; t++)
+		total += E.mem.used[t];
+	return total;
+}
+
+int memOver(int tag) {
+	memstats *m = &E.mem;
+	for(int t = 0; t < MEM_TAGS; t++)
+		if((tag == MEM_TAGS || tag == t) && m->budget[t] && m->used[t] > m->budget[t]) return 1;
+	return tag == MEM_TAGS && memOverLimit();
+}
+
+int memOverLimit() {
+	return E.mem.limit && memTotal() > E.mem.limit;
+}
+
+int memParse(const char *spec) {
+	char *s = strdup(spec), *save = NULL;
+	int ok = 1;
+	for(char *item = strtok_r(s, ",", &save); item && ok; item = strtok_r(NULL, ",", &save)) {
+		long long *slot = &E.mem.limit;
+		char *eq = strchr(item, '='), *end;
+		if(eq) {
+			*eq = '\0';
+			slot = NULL;
+			for(int t = 0; t < MEM_TAGS; t++)
+				if(strcmp(item, memnames[t]) == 0) slot = &E.mem.budget[t];
+			item = eq + 1;
+		}
+		double mb = strtod(item, &end);
+		ok = slot && end != item && *end == '\0' && mb > 0;
+		if(ok) *slot = mb * MEM_MB;
+	}
+	free(s);
+	return ok;
+}
+
+void memDropRender() {
+	for(int i = 0; i < E.numrows; i++) {
+		erow *row = editorRow(i);
+		if(row->cold || (i >= E.rowoff - E.rows && i < E.rowoff + 2 * E.rows)) continue;
+		memFree(MEM_RENDER, row->render);
+		memFree(MEM_RENDER, row->hl);
+		row->render = NULL;
+		row->hl = NULL;
+	}
+}
+
+int memDropBuffer() {
+	if(E.dirty || E.filename == NULL || E.save.snap || E.save.pending) return 0;
+	if(access(E.filename, R_OK) == -1) return 0;
+	editorUndoClear();
+	diffstate *d = &E.diff;
+	if(d->base) snapshotRelease(d->base);
+	for(int i = 0; i < E.numrows; i++)
+		editorFreeRow(editorRow(i));
+	editorRowsFree();
+	E.numrows = 0;
+	editorIndexReset();
+	memFree(MEM_INDEX, E.brackets.node);
+	memFree(MEM_INDEX, E.brackets.ev);
+	memset(&E.brackets, 0, sizeof(brackettree));
+	memFree(MEM_INDEX, d->disk);
+	d->base = NULL;
+	d->disk = NULL;
+	d->numdisk = 0;
+	fenwick *f[] = {&E.bytes, &E.wrap};
+	for(int i = 0; i < 2; i++)
+		fenwickFree(f[i]);
+	memFree(MEM_ROWS, E.graves);
+	E.graves = NULL;
+	E.numgraves = 0;
+	free(E.coldbuf);
+	E.coldbuf = NULL;
+	E.coldblk = NULL;
+	E.cx = E.cy = E.rx = 0;
+	E.rowoff = E.coloff = 0;
+	E.softwrap = 0;
+	E.mark = -1;
+	pagerAttach();
+	return 1;
+}
+
+void memEnforce() {
+	memstats *m = &E.mem;
+	if(E.pager || !memOver(MEM_TAGS)) return;
+	int total = memOverLimit() && editorNow() >= m->shed;
+	if(total)
+		m->shed = editorNow() + MEM_SHED_MS * 1000LL;
+	else {
+		int over = 0;
+		for(int t = 0; t < MEM_TAGS; t++)
+			over |= memOver(t);
+		if(!over) return;
+	}
+	int before = E.undo.numnodes;
+	if(memOver(MEM_RENDER) || (total && memOverLimit()))
+		memDropRender();
+	if(memOver(MEM_UNDO) || memOver(MEM_ROWS) || (total && memOverLimit()))
+		editorUndoDropChecks();
+	if(memOver(MEM_TEXT) || (total && memOverLimit())) {
+		E.coldenabled = 1;
+		editorColdSweep(0, E.numrows, 1);
+	}
+	while(memOver(MEM_UNDO) && editorUndoTrim());
+	if(total && memOverLimit())
+		editorUndoTrim();
+	if(E.undo.numnodes < before)
+		editorSetStatusMsg("Over memory budget: undo history trimmed to %d revisions", E.undo.numnodes);
+	if(!memOver(MEM_TAGS)) return;
+	if(memDropBuffer()) {
+		editorSetStatusMsg("Over memory budget: reopened read-only");
+		return;
+	}
+	if(time(NULL) - E.mem.warned >= MEM_WARN_SECS) {
+		E.mem.warned = time(NULL);
+		editorSetStatusMsg("Over memory budget: save to reopen read-only (Alt-u for usage)");
+	}
+}
+
+char *memFormat(long long n, char *buf) {
+	if(n < MEM_MB)
+		sprintf(buf, "%lldK", n / 1024);
+	else
+		sprintf(buf, "%.1fM", (double)n / MEM_MB);
+	return buf;
+}
+
+void memReport() {
+	char msg[sizeof(E.statusmsg)], num[3][32];
+	struct mallinfo2 mi = mallinfo2();
+	int len = snprintf(msg, sizeof(msg), "total %s/%s heap %s:", memFormat(memTotal(), num[0]),
+		E.mem.limit ? memFormat(E.mem.limit, num[1]) : "-", memFormat(mi.uordblks + mi.hblkhd, num[2]));
+	for(int t = 0; t < MEM_TAGS && len < (int)sizeof(msg); t++) {
+		if(E.mem.used[t] < 1024 && !E.mem.budget[t]) continue;
+		len += snprintf(&msg[len], sizeof(msg) - len, " %s %s%s%s", memnames[t], memFormat(E.mem.used[t], num[0]),
+			E.mem.budget[t] ? "/" : "", E.mem.budget[t] ? memFormat(E.mem.budget[t], num[1]) : "");
+	}
+	editorSetStatusMsg("%s", msg);
+}
+
+void abAppend(abuf *ab, const char *s, int len) {
+	abAppendHl(ab, s, len, NULL);
+}
+
+void abAppendHl(abuf *ab, const char *s, int len, const unsigned char *hl) {
+	char *new = memRealloc(MEM_SCREEN, ab->b, ab->len + len);
+	if(new == NULL) return;
+	ab->b = new;
+	unsigned char *c = memRealloc(MEM_SCREEN, ab->c, ab->len + len);
+	if(c == NULL) return;
+	ab->c = c;
+
+	memcpy(&new[ab->len], s, len);
+	if(hl)
+		memcpy(&c[ab->len], hl, len);
+	else
+		memset(&c[ab->len], 5, len);
+	ab->len += len;
+}
+
+void abAppendColor(abuf *ab, const char *s, int len, unsigned char color) {
+	char *new = memRealloc(MEM_SCREEN, ab->b, ab->len + len);
+	if(new == NULL) return;
+	ab->b = new;
+	unsigned char *c = memRealloc(MEM_SCREEN, ab->c, ab->len + len);
+	if(c == NULL) return;
+	ab->c = c;
+
+	memcpy(&new[ab->len], s, len);
+	memset(&c[ab->len], color, len);
+	ab->len += len;
+}
+
+void abFree(abuf *ab) {
+	memFree(MEM_SCREEN, ab->b);
+	memFree(MEM_SCREEN, ab->c);
+}
+
+int utf8Decode(const char *s, int len, int *cp) {
+	const unsigned char *u = (const unsigned char *)s;
+	int n, c;
+	if(u[0] < 0x80) {
+		*cp = u[0];
+		return 1;
+	}
+	else if(u[0] >= 0xC2 && u[0] <= 0xDF) {
+		n = 2;
+		c = u[0] & 0x1F;
+	}
+	else if(u[0] >= 0xE0 && u[0] <= 0xEF) {
+		n = 3;
+		c = u[0] & 0x0F;
+	}
+	else if(u[0] >= 0xF0 && u[0] <= 0xF4) {
+		n = 4;
+		c = u[0] & 0x07;
+	}
+	else {
+		*cp = 0xFFFD;
+		return 1;
+	}
+	if(n > len) {
+		*cp = 0xFFFD;
+		return 1;
+	}
+	for(int i = 1; i < n; i++) {
+		if((u[i] & 0xC0) != 0x80) {
+			*cp = 0xFFFD;
+			return 1;
+		}
+		c = (c << 6) | (u[i] & 0x3F);
+	}
+	if((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF)) || (c >= 0xD800 && c <= 0xDFFF)) {
+		*cp = 0xFFFD;
+		return 1;
+	}
+	*cp = c;
+	return n;
+}
+
+int utf8Encode(int cp, char *out) {
+	if(cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	}
+	else if(cp < 0x800) {
+		out[0] = 0xC0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3F);
+		return 2;
+	}
+	else if(cp < 0x10000) {
+		out[0] = 0xE0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3F);
+		out[2] = 0x80 | (cp & 0x3F);
+		return 3;
+	}
+	out[0] = 0xF0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3F);
+	out[2] = 0x80 | ((cp >> 6) & 0x3F);
+	out[3] = 0x80 | (cp & 0x3F);
+	return 4;
+}
+
+int utf8Width(int cp) {
+	static unsigned char width_cache[0x10000];
+	if(cp < 0x10000 && width_cache[cp])
+		return width_cache[cp] - 1;
+	int w = wcwidth(cp);
+	if(w < 0) w = 1;
+	if(cp < 0x10000)
+		width_cache[cp] = w + 1;
+	return w;
+}
+
+int editorIsAscii(const char *s, int len) {
+	int i = 0;
+#ifdef __SSE2__
+	for(; i + 64 <= len; i += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(s + i + 48));
+		if(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))
+			return 0;
+	}
+	for(; i + 16 <= len; i += 16) {
+		if(_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))))
+			return 0;
+	}
+#endif
+	for(; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		if(w & 0x8080808080808080ULL)
+			return 0;
+	}
+	for(; i < len; i++)
+		if((unsigned char)s[i] & 0x80) return 0;
+	return 1;
+}
+
+int editorRowNextCx(erow *row, int cx) {
+	if(cx >= row->size) return row->size;
+	if(row->ascii) return cx + 1;
+	int cp;
+	cx += utf8Decode(&row->chars[cx], row->size - cx, &cp);
+	while(cx < row->size) {
+		int n = utf8Decode(&row->chars[cx], row->size - cx, &cp);
+		if(cp == '\t' || utf8Width(cp) != 0) break;
+		cx += n;
+	}
+	return cx;
+}
+
+int editorRowPrevCp(erow *row, int cx) {
+	if(cx <= 0) return 0;
+	if(row->ascii) return cx - 1;
+	int start = cx - 1;
+	while(start > 0 && cx - start < 4 && ((unsigned char)row->chars[start] & 0xC0) == 0x80)
+		start--;
+	int cp;
+	if(start + utf8Decode(&row->chars[start], row->size - start, &cp) != cx)
+		return cx - 1;
+	return start;
+}
+
+int editorRowPrevCx(erow *row, int cx) {
+	if(row->ascii) return cx > 0 ? cx - 1 : 0;
+	int cp;
+	do {
+		cx = editorRowPrevCp(row, cx);
+		utf8Decode(&row->chars[cx], row->size - cx, &cp);
+	} while(cx > 0 && cp != '\t' && utf8Width(cp) == 0);
+	return cx;
+}
+
+int editorRowSnapCx(erow *row, int cx) {
+	if(cx >= row->size) return row->size;
+	if(row->ascii || cx <= 0) return cx;
+	int start = cx, cp;
+	while(start > 0 && cx - start < 3 && ((unsigned char)row->chars[start] & 0xC0) == 0x80)
+		start--;
+	if(start + utf8Decode(&row->chars[start], row->size - start, &cp) > cx)
+		cx = start;
+	utf8Decode(&row->chars[cx], row->size - cx, &cp);
+	while(cx > 0 && cp != '\t' && utf8Width(cp) == 0) {
+		cx = editorRowPrevCp(row, cx);
+		utf8Decode(&row->chars[cx], row->size - cx, &cp);
+	}
+	return cx;
+}
+
+int editorRenderByteToRx(erow *row, int off) {
+	if(row->ascii) return off;
+	int rx = 0, cp;
+	for(int j = 0; j < off;) {
+		j += utf8Decode(&row->render[j], row->rsize - j, &cp);
+		rx += utf8Width(cp);
+	}
+	return rx;
+}
+
+void editorAppendSpan(abuf *ab, const char *s, int len, int ascii, int coloff, int width, const unsigned char *hl) {
+	if(width <= 0) return;
+	if(ascii) {
+		len -= coloff;
+		if(len <= 0) return;
+		if(len > width) len = width;
+		abAppendHl(ab, &s[coloff], len, hl ? &hl[coloff] : NULL);
+		return;
+	}
+	int col = 0, j = 0, cp, n, w;
+	int end = coloff + width;
+	while(j < len) {
+		n = utf8Decode(&s[j], len - j, &cp);
+		w = utf8Width(cp);
+		if(col + w > coloff) break;
+		col += w;
+		j += n;
+	}
+	if(j < len && col < coloff) {
+		n = utf8Decode(&s[j], len - j, &cp);
+		col += utf8Width(cp);
+		j += n;
+		for(int c = coloff; c < col && c < end; c++)
+			abAppend(ab, " ", 1);
+	}
+	int start = j;
+	while(j < len) {
+		n = utf8Decode(&s[j], len - j, &cp);
+		w = utf8Width(cp);
+		if(col + w > end) break;
+		col += w;
+		j += n;
+	}
+	abAppendHl(ab, &s[start], j - start, hl ? &hl[start] : NULL);
+}
+
+void editorPutStr(const char *s, int len) {
+	if(editorIsAscii(s, len)) {
+		addnstr(s, len);
+		return;
+	}
+	wchar_t ws[len];
+	int n = 0, cp;
+	for(int j = 0; j < len;) {
+		j += utf8Decode(&s[j], len - j, &cp);
+		ws[n++] = cp;
+	}
+	addnwstr(ws, n);
+}
+
+int editorReadUtf8(int c) {
+	char seq[4];
+	int n;
+	if(c >= 0xC2 && c <= 0xDF) n = 2;
+	else if(c >= 0xE0 && c <= 0xEF) n = 3;
+	else if(c >= 0xF0 && c <= 0xF4) n = 4;
+	else return -1;
+	seq[0] = c;
+	for(int i = 1; i < n; i++) {
+		int b = getch();
+		if(b < 0x80 || b > 0xBF) return -1;
+		seq[i] = b;
+	}
+	int cp;
+	if(utf8Decode(seq, n, &cp) != n) return -1;
+	return cp;
+}
+
+int editorRowCxToRx(erow *row, int cx) {
+	int rx = 0;
+	if(row->ascii) {
+		for(int j = 0; j < cx; j++) {
+			if(row->chars[j] == '\t')
+				rx += (TAB_STOP - 1) - (rx % TAB_STOP);
+			rx++;
+		}
+		return rx;
+	}
+	int cp;
+	for(int j = 0; j < cx && j < row->size;) {
+		if(row->chars[j] == '\t') {
+			rx += TAB_STOP - (rx % TAB_STOP);
+			j++;
+			continue;
+		}
+		j += utf8Decode(&row->chars[j], row->size - j, &cp);
+		rx += utf8Width(cp);
+	}
+	return rx;
+}
+
+int editorRowRxToCx(erow *row, int rx) {
+	int cur_rx = 0;
+	int cx;
+	if(row->ascii) {
+		for(cx = 0; cx < row->size; cx++) {
+			if(row->chars[cx] == '\t')
+				cur_rx += (TAB_STOP - 1) - (cur_rx % TAB_STOP);
+			cur_rx++;
+			if(cur_rx > rx) return cx;
+		}
+		return cx;
+	}
+	int cp, n;
+	for(cx = 0; cx < row->size; cx += n) {
+		if(row->chars[cx] == '\t') {
+			n = 1;
+			cur_rx += TAB_STOP - (cur_rx % TAB_STOP);
+		}
+		else {
+			n = utf8Decode(&row->chars[cx], row->size - cx, &cp);
+			cur_rx += utf8Width(cp);
+		}
+		if(cur_rx > rx) return editorRowSnapCx(row, cx);
+	}
+	return cx;
+}
+
+void editorScroll() {
+	E.rx = 0;
+	if(E.cy < E.numrows) {
+		E.rx = editorRowCxToRx(editorRowAt(E.cy), E.cx);
+	}
+	if(E.softwrap) {
+		int y, x;
+		E.coloff = 0;
+		if(E.rowoff > E.numrows) E.rowoff = E.numrows;
+		long long top = editorWrapTop();
+		editorScreenPos(E.cy, E.rx, &y, &x);
+		if(y < 0) top += y;
+		if(y >= E.rows) top += y - E.rows + 1;
+		editorWrapScroll(top);
+		return;
+	}
+	if(E.cy < E.rowoff) {
+		E.rowoff = E.cy;
+	}
+	if(E.cy >= E.rowoff + E.rows) {
+		E.rowoff = E.cy - E.rows + 1;
+	}
+	if(E.rx < E.coloff) {
+		E.coloff = E.rx;
+	}
+	if(E.rx >= E.coloff + E.cols) {
+		E.coloff = E.rx - E.cols + 1;
+	}
+}
+
+void editorCharToChtype(abuf *ab) {
+	int len = ab->len;
+	len += 1;
+}
+
+void editorDrawRows(abuf *ab) {
+	if(E.pager) {
+		pagerDrawRows(ab);
+		return;
+	}
+	if(E.softwrap && E.numrows) {
+		editorDrawWrapped(ab);
+		return;
+	}
+	for(int i = 0; i < E.rows; i++) {
+		int filerow = i + E.rowoff;
+		if(filerow >= E.numrows) {
+			if(!E.dirty) {
+				if(E.numrows == 0 && i == E.rows / 3) {
+					char welcome[80];
+					int welcomelen = snprintf(welcome, sizeof(welcome), "Text editor");
+					if(welcomelen > E.cols) welcomelen = E.cols;
+					int padding = (E.cols - welcomelen) / 2;
+					if(padding) {
+						abAppend(ab, "~", 1);
+						padding--;
+					}
+					while(padding--) abAppend(ab, " ", 1);
+					abAppend(ab, welcome, welcomelen);
+				}
 				else {
-					attron(COLOR_PAIR(5));
-					printw("%s", word);
-					attroff(5);
+					abAppend(ab, "~", 1);
+				}
+			}
+			else {
+				abAppend(ab, " ", 1);
+			}
+		}
+		else {
+			E.line_width = (int)log10(E.numrows) + 1;
+			int line_number = filerow + 1;
+			char line_number_str[E.line_width + 1];
+			snprintf(line_number_str, sizeof(line_number_str), "%*d ", E.line_width, line_number);
+			abAppendColor(ab, line_number_str, strlen(line_number_str), filerow == E.mark ? 6 | HL_REVERSE : 6);
+			erow *row = editorRowSyntax(filerow);
+			int mark = E.diff.enabled ? row->diff : DIFF_SAME;
+			if(mark == DIFF_SAME && E.diff.enabled && E.diff.taildel && filerow == E.numrows - 1)
+				mark = DIFF_DEL;
+			unsigned char color = mark == DIFF_ADD ? 4 : mark == DIFF_CHANGE ? 3 : mark == DIFF_DEL ? 6 : 5;
+			abAppendHl(ab, &" +~-"[mark], 1, &color);
+			editorAppendSpan(ab, row->render, row->rsize, row->ascii, E.coloff, E.cols - E.line_width - 2, row->hl);
+		}
+		abAppend(ab, "\n", 1);
+	}
+}
+
+void editorDrawWrapped(abuf *ab) {
+	int width = editorWrapWidth();
+	fenwick *w = editorWrapIndex();
+	int filerow = E.rowoff, seg = E.wrapoff;
+	for(int i = 0; i < E.rows; i++) {
+		if(filerow >= E.numrows) {
+			abAppend(ab, E.dirty ? " " : "~", 1);
+			abAppend(ab, "\n", 1);
+			continue;
+		}
+		int segrx = editorWrapSegStart(filerow, seg);
+		erow *row = editorRowSyntax(filerow);
+		char line_number_str[E.line_width + 1];
+		if(seg == 0)
+			snprintf(line_number_str, sizeof(line_number_str), "%*d ", E.line_width, filerow + 1);
+		else
+			snprintf(line_number_str, sizeof(line_number_str), "%*s ", E.line_width, "");
+		abAppendColor(ab, line_number_str, strlen(line_number_str), filerow == E.mark && seg == 0 ? 6 | HL_REVERSE : 6);
+		int mark = E.diff.enabled && seg == 0 ? row->diff : DIFF_SAME;
+		if(mark == DIFF_SAME && E.diff.enabled && E.diff.taildel && filerow == E.numrows - 1 && seg == 0)
+			mark = DIFF_DEL;
+		unsigned char color = mark == DIFF_ADD ? 4 : mark == DIFF_CHANGE ? 3 : mark == DIFF_DEL ? 6 : 5;
+		abAppendHl(ab, &" +~-"[mark], 1, &color);
+		editorAppendSpan(ab, row->render, row->rsize, row->ascii, segrx, width, row->hl);
+		abAppend(ab, "\n", 1);
+		if(++seg >= fenwickGet(w, filerow)) {
+			filerow++;
+			seg = 0;
+		}
+	}
+}
+
+void editorDrawStatusBar(abuf *ab) {
+	char status[80], rstatus[80];
+	int len, rlen;
+	if(E.pager) {
+		pagerDrawStatus(status, &len, rstatus, &rlen);
+	}
+	else {
+		len = snprintf(status, sizeof(status), "%s - %d lines %s", E.filename ? E.filename : "[No Name]", E.numrows, E.dirty ? "(modified)" : "");
+		if(E.brackets.valid) {
+			brackettree *b = editorBrackets();
+			if(b->depth > b->numpath && b->numpath)
+				len += snprintf(&status[len], sizeof(status) - len, " ..");
+			for(int i = b->numpath - 1; i >= 0 && len < (int)sizeof(status); i--)
+				len += snprintf(&status[len], sizeof(status) - len, " %c%d", b->pathch[i], b->path[i][0] + 1);
+		}
+		if(len >= (int)sizeof(status)) len = sizeof(status) - 1;
+		fenwick *bytes = editorByteIndex();
+		long long pos = fenwickPrefix(bytes, E.cy) + (E.cy < E.numrows ? E.cx : 0);
+		rlen = snprintf(rstatus, sizeof(rstatus), "%lld/%lld B | %d/%d", pos, fenwickPrefix(bytes, E.numrows), E.cy + 1, E.numrows);
+	}
+	if(len > E.cols) len = E.cols;
+	abAppendColor(ab, status, len, 1);
+	while(len < E.cols - 1) {
+		if(E.cols - len - 1 == rlen) {
+			abAppendColor(ab, rstatus, rlen, 1);
+			break;
+		}
+		else
+			abAppendColor(ab, " ", 1, 1);
+		len++;
+	}
+	abAppend(ab, "\n", 1);
+}
+
+void editorDrawMsgBar(abuf *ab) {
+	int len = strlen(E.statusmsg);
+	if(len > E.cols) len = E.cols;
+	if(len && time(NULL) - E.statusmsg_time < 3)
+		abAppendColor(ab, E.statusmsg, len, 10);
+}
+
+#define MAX_LINE_LENGTH 1024
+
+const char *keywords[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double",
+    "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register",
+    "restrict", "return", "short", "signed", "sizeof", "static", "struct", "switch", "typedef",
+    "union", "unsigned", "void", "volatile", "while"
+};
+
+#define NUM_KEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+
+int is_keyword(const char *word) {
+    for(long unsigned int i = 0; i < NUM_KEYWORDS; i++) {
+        if(strcmp(word, keywords[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void highlight_buffer(const char *buffer, int len, unsigned char *hl) {
+	char word[MAX_LINE_LENGTH];
+	int in_string = 0;
+	int in_comment = 0;
+
+	for(int i = 0; i < len; ) {
+		unsigned char ch = buffer[i];
+		int n = 1, cp;
+		if(ch >= 0x80)
+			n = utf8Decode(&buffer[i], len - i, &cp);
+		if(in_comment) {
+			memset(&hl[i], 4, n);
+			if(ch == '\n') {
+				in_comment = 0;
+			}
+		}
+		else if(in_string) {
+			memset(&hl[i], 3, n);
+			if(ch == '"') {
+				in_string = 0;
+			}
+		}
+		else if(ch == '"') {
+			in_string = 1;
+			hl[i] = 3;
+		}
+		else if(ch == '/' && i + 1 < len && buffer[i + 1] == '/') {
+			in_comment = 1;
+			hl[i] = hl[i + 1] = 4;
+			n = 2;
+		}
+		else if(ch < 0x80 && (isspace(ch) || ispunct(ch))) {
+			hl[i] = 5;
+		}
+		else if(ch < 0x80 && isdigit(ch)) {
+			hl[i] = 6;
+		}
+		else {
+			int word_len = 0, j = i;
+			do {
+				int m = 1;
+				if((unsigned char)buffer[j] >= 0x80)
+					m = utf8Decode(&buffer[j], len - j, &cp);
+				if(!isdigit((unsigned char)buffer[j]) && word_len + m < MAX_LINE_LENGTH) {
+					memcpy(&word[word_len], &buffer[j], m);
+					word_len += m;
+				}
+				j += m;
+			} while(j < len && (isalnum((unsigned char)buffer[j]) || (unsigned char)buffer[j] >= 0x80));
+			word[word_len] = '\0';
+			int color = is_keyword(word) ? 2 : 5;
+			for(int k = i; k < j; k++)
+				hl[k] = isdigit((unsigned char)buffer[k]) ? 6 : color;
+			n = j - i;
+		}
+		i += n;
+	}
+}
+
+void editorPutBuffer(abuf *ab) {
+	int i = 0;
+	while(i < ab->len) {
+		int j = i;
+		while(j < ab->len && ab->c[j] == ab->c[i]) j++;
+		unsigned char c = ab->c[i];
+		attr_t attr = COLOR_PAIR(c & HL_PAIR) | (c & HL_BOLD ? A_BOLD : 0) | (c & HL_REVERSE ? A_REVERSE : 0);
+		attron(attr);
+		editorPutStr(&ab->b[i], j - i);
+		attroff(attr);
+		i = j;
+	}
+}
+
+void editorRefreshScreen() {
+	getWindowSize(&E.cols, &E.rows);
+	editorScroll();
+
+	abuf ab = ABUF_INIT;
+
+	editorDrawRows(&ab);
+	editorDrawStatusBar(&ab);
+	editorDrawMsgBar(&ab);
+	editorDrawBlock(&ab);
+	if(E.vt.enabled) {
+		vtFlush(&ab);
+	}
+	else {
+		curs_set(0);
+		erase();
+		move(0, 0);
+		editorPutBuffer(&ab);
+		refresh();
+		int y, x;
+		editorScreenPos(E.cy, E.rx, &y, &x);
+		move(y, x + E.line_width + 1);
+		curs_set(E.pager ? 0 : 2);
+	}
+	abFree(&ab);
+}
+
+const unsigned char vtcolors[][6] = {
+	{229, 229, 229, 48, 48, 54},
+	{48, 48, 54, 229, 229, 229},
+	{48, 188, 237, 48, 48, 54},
+	{205, 205, 0, 48, 48, 54},
+	{0, 205, 0, 48, 48, 54},
+	{229, 229, 229, 48, 48, 54},
+	{255, 0, 0, 48, 48, 54}
+};
+
+#define NUM_VT_COLORS (sizeof(vtcolors) / sizeof(vtcolors[0]))
+
+void vtAppend(vtbuf *b, const char *s, int len) {
+	if(b->len + len > b->cap) {
+		b->cap = b->cap * 2 > b->len + len ? b->cap * 2 : b->len + len + 256;
+		b->b = memRealloc(MEM_SCREEN, b->b, b->cap);
+	}
+	memcpy(&b->b[b->len], s, len);
+	b->len += len;
+}
+
+const unsigned char *vtRgb(int color, int bg) {
+	unsigned int pair = color & HL_PAIR;
+	const unsigned char *c = vtcolors[pair < NUM_VT_COLORS ? pair : 0];
+	if(color & HL_REVERSE) bg = !bg;
+	return bg ? c + 3 : c;
+}
+
+void vtSgr(int color, int plain) {
+	vtscreen *V = &E.vt;
+	const unsigned char *rgb[2] = {vtRgb(color, 0), vtRgb(color, 1)};
+	int all = V->sgr == -1, bold = (color & HL_BOLD) != 0, rev = 0;
+	if(!plain && !all) {
+		int direct = V->rev + 4 * (memcmp(V->fg, rgb[0], 3) != 0) + 4 * (memcmp(V->bg, rgb[1], 3) != 0);
+		int swapped = !V->rev + 4 * (memcmp(V->fg, rgb[1], 3) != 0) + 4 * (memcmp(V->bg, rgb[0], 3) != 0);
+		rev = swapped < direct;
+	}
+	const unsigned char *fg = rgb[rev], *bg = rgb[!rev];
+	char seq[80] = "\x1b[";
+	int len = 2;
+	if(all)
+		len += snprintf(&seq[len], sizeof(seq) - len, "0;");
+	if(all ? bold : bold != V->bold)
+		len += snprintf(&seq[len], sizeof(seq) - len, "%s", bold ? "1;" : "22;");
+	if(all ? rev : rev != V->rev)
+		len += snprintf(&seq[len], sizeof(seq) - len, "%s", rev ? "7;" : "27;");
+	if(all || memcmp(fg, V->fg, 3))
+		len += snprintf(&seq[len], sizeof(seq) - len, "38;2;%d;%d;%d;", fg[0], fg[1], fg[2]);
+	if(all || memcmp(bg, V->bg, 3))
+		len += snprintf(&seq[len], sizeof(seq) - len, "48;2;%d;%d;%d;", bg[0], bg[1], bg[2]);
+	V->sgr = color;
+	V->bold = bold;
+	V->rev = rev;
+	memcpy(V->fg, fg, 3);
+	memcpy(V->bg, bg, 3);
+	if(len == 2) return;
+	seq[len - 1] = 'm';
+	vtAppend(&V->out, seq, len);
+}
+
+int vtWidth(const char *s, int len) {
+	int w = 0;
+	for(int i = 0; i < len;) {
+		int cp = (unsigned char)s[i], n = 1;
+		if(cp >= 0x80) {
+			n = utf8Decode(&s[i], len - i, &cp);
+			w += utf8Width(cp);
+		}
+		else
+			w++;
+		i += n;
+	}
+	return w;
+}
+
+void vtMove(int y, int x) {
+	vtscreen *V = &E.vt;
+	char seq[32];
+	int n;
+	if(y == V->cy && x == V->cx) return;
+	if(y == V->cy && x == 0)
+		n = snprintf(seq, sizeof(seq), "\r");
+	else if(y == V->cy)
+		n = snprintf(seq, sizeof(seq), "\x1b[%dG", x + 1);
+	else if(y == V->cy + 1 && V->cy != -1 && x == 0)
+		n = snprintf(seq, sizeof(seq), "\r\n");
+	else if(x == 0)
+		n = snprintf(seq, sizeof(seq), "\x1b[%dH", y + 1);
+	else
+		n = snprintf(seq, sizeof(seq), "\x1b[%d;%dH", y + 1, x + 1);
+	vtAppend(&V->out, seq, n);
+	V->cy = y;
+	V->cx = x;
+}
+
+void vtPut(const char *s, const unsigned char *c, int len) {
+	vtscreen *V = &E.vt;
+	V->cx += vtWidth(s, len);
+	if(V->cx >= E.cols) V->cy = V->cx = -1;
+	for(int i = 0; i < len;) {
+		const unsigned char *bg = V->rev ? V->fg : V->bg;
+		int j = i;
+		while(j < len && (unsigned char)s[j] >= 0x20 && s[j] != 0x7f && V->sgr != -1 &&
+				(c[j] == V->sgr || (s[j] == ' ' && memcmp(bg, vtRgb(c[j], 1), 3) == 0)))
+			j++;
+		if(j > i) {
+			vtAppend(&V->out, &s[i], j - i);
+			i = j;
+		}
+		else if(c[i] != V->sgr) {
+			vtSgr(c[i], 0);
+		}
+		else {
+			vtAppend(&V->out, "?", 1);
+			i++;
+		}
+	}
+}
+
+void vtDrawLine(int y, const char *s, const unsigned char *c, int len) {
+	vtscreen *V = &E.vt;
+	vtbuf *old = &V->line[y];
+	int oldlen = old->len / 2, from = 0, to = len, oldto = oldlen;
+	const char *os = old->b;
+	const unsigned char *oc = (const unsigned char *)old->b + oldlen;
+	if(old->len >= 0) {
+		if(oldlen == len && memcmp(os, s, len) == 0 && memcmp(oc, c, len) == 0) return;
+		while(from < len && from < oldlen && s[from] == os[from] && c[from] == oc[from]) from++;
+		while(to > from && oldto > from && s[to - 1] == os[oldto - 1] && c[to - 1] == oc[oldto - 1]) {
+			to--;
+			oldto--;
+		}
+		while(from > 0 && from < len && ((unsigned char)s[from] & 0xC0) == 0x80) from--;
+		while(to < len && ((unsigned char)s[to] & 0xC0) == 0x80) {
+			to++;
+			oldto++;
+		}
+		int cp;
+		while(from > 0 && from < len && (unsigned char)s[from] >= 0x80 &&
+				(utf8Decode(&s[from], len - from, &cp), utf8Width(cp) == 0)) {
+			from--;
+			while(from > 0 && ((unsigned char)s[from] & 0xC0) == 0x80) from--;
+		}
+		if(vtWidth(&s[from], to - from) != vtWidth(&os[from], oldto - from)) {
+			to = len;
+			oldto = oldlen;
+		}
+	}
+
+	int col = vtWidth(s, from);
+	if(old->len >= 0 && to == oldto && editorIsAscii(&s[from], to - from) && editorIsAscii(&os[from], to - from)) {
+		for(int i = from; i < to;) {
+			int j = i, gap = 0;
+			while(j < to && gap < VT_MIN_GAP) {
+				gap = s[j] == os[j] && c[j] == oc[j] ? gap + 1 : 0;
+				j++;
+			}
+			vtMove(y, col + i - from);
+			vtPut(&s[i], &c[i], j - gap - i);
+			i = j;
+			while(i < to && s[i] == os[i] && c[i] == oc[i]) i++;
+		}
+	}
+	else {
+		vtMove(y, col);
+		vtPut(&s[from], &c[from], to - from);
+	}
+	if(to == len) {
+		int width = vtWidth(s, len);
+		if(width < E.cols && (old->len < 0 || vtWidth(os, oldlen) > width)) {
+			if(V->sgr == -1 || V->rev || memcmp(V->bg, vtRgb(10, 1), 3))
+				vtSgr(10, 1);
+			vtAppend(&V->out, "\x1b[K", 3);
+		}
+	}
+
+	old->len = 0;
+	vtAppend(old, s, len);
+	vtAppend(old, (const char *)c, len);
+}
+
+unsigned int vtHash(const char *s, const unsigned char *c, int len) {
+	unsigned int h = 2166136261u;
+	for(int i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	for(int i = 0; i < len; i++)
+		h = (h ^ c[i]) * 16777619u;
+	return h;
+}
+
+void vtScroll(const unsigned int *hash, int rows) {
+	vtscreen *V = &E.vt;
+	if(rows < 2) return;
+	unsigned int old[rows];
+	int same = 0, best = 0, bestcount = 0, tries = 0;
+	for(int y = 0; y < rows; y++) {
+		vtbuf *l = &V->line[y];
+		old[y] = l->len < 0 ? hash[y] + 1 : vtHash(l->b, (unsigned char *)l->b + l->len / 2, l->len / 2);
+		same += old[y] == hash[y];
+	}
+	for(int y = 0; y < rows && tries < 8; y++) {
+		for(int j = 0; j < rows; j++) {
+			if(j == y || old[j] != hash[y]) continue;
+			int d = j - y, count = 0;
+			for(int k = 0; k < rows; k++)
+				count += k + d >= 0 && k + d < rows && hash[k] == old[k + d];
+			if(count > bestcount) {
+				best = d;
+				bestcount = count;
+			}
+			tries++;
+			break;
+		}
+	}
+	if(best == 0 || bestcount < same + 3) return;
+
+	char seq[64];
+	int n = snprintf(seq, sizeof(seq), "\x1b[1;%dr\x1b[%d%c\x1b[r", rows, best > 0 ? best : -best, best > 0 ? 'S' : 'T');
+	vtAppend(&V->out, seq, n);
+	V->cy = V->cx = 0;
+	for(int k = 0; k < rows; k++) {
+		int y = best > 0 ? k : rows - 1 - k, from = y + best;
+		if(from >= 0 && from < rows) {
+			vtbuf t = V->line[y];
+			V->line[y] = V->line[from];
+			V->line[from] = t;
+		}
+		else
+			V->line[y].len = -1;
+	}
+}
+
+void vtFlush(abuf *ab) {
+	vtscreen *V = &E.vt;
+	int rows = E.rows + 2;
+	if(rows != V->rows || E.cols != V->cols) {
+		refresh();
+		for(int y = 0; y < V->rows; y++)
+			memFree(MEM_SCREEN, V->line[y].b);
+		memFree(MEM_SCREEN, V->line);
+		V->line = memAlloc(MEM_SCREEN, sizeof(vtbuf) * rows);
+		memset(V->line, 0, sizeof(vtbuf) * rows);
+		for(int y = 0; y < rows; y++)
+			V->line[y].len = -1;
+		V->rows = rows;
+		V->cols = E.cols;
+		V->sgr = -1;
+		V->cy = V->cx = -1;
+		V->show = -1;
+	}
+
+	V->out.len = 0;
+	vtAppend(&V->out, "\x1b[?2026h\x1b[?25l", 14);
+	if(V->sgr == -1) {
+		vtAppend(&V->out, "\x1b[r", 3);
+		V->cy = V->cx = 0;
+	}
+	int head = V->out.len;
+	int start[rows], len[rows], i = 0;
+	unsigned int hash[rows];
+	memset(hash, 0, sizeof(hash));
+	for(int y = 0; y < rows; y++) {
+		const char *nl = i < ab->len ? memchr(&ab->b[i], '\n', ab->len - i) : NULL;
+		start[y] = i < ab->len ? i : 0;
+		len[y] = i < ab->len ? (nl ? nl - ab->b : ab->len) - i : 0;
+		hash[y] = vtHash(&ab->b[start[y]], &ab->c[start[y]], len[y]);
+		i += len[y] + 1;
+	}
+	vtScroll(hash, E.rows);
+	for(int y = 0; y < rows; y++)
+		vtDrawLine(y, &ab->b[start[y]], &ab->c[start[y]], len[y]);
+
+	int show = !E.pager, cy, cx;
+	editorScreenPos(E.cy, E.rx, &cy, &cx);
+	cx += E.line_width + 1;
+	int body = V->out.len > head;
+	if(!body) {
+		if(show == V->show && (!show || (cy == V->cy && cx == V->cx))) return;
+		V->out.len = 0;
+	}
+	if(show) {
+		vtMove(cy, cx);
+		vtAppend(&V->out, "\x1b[?25h", 6);
+	}
+	else if(!body)
+		vtAppend(&V->out, "\x1b[?25l", 6);
+	V->show = show;
+	if(body)
+		vtAppend(&V->out, "\x1b[?2026l", 8);
+
+	const char *p = V->out.b;
+	int left = V->out.len;
+	while(left > 0) {
+		ssize_t n = write(STDOUT_FILENO, p, left);
+		if(n == -1 && errno == EINTR) continue;
+		if(n <= 0) break;
+		p += n;
+		left -= n;
+	}
+}
+
+void editorSetStatusMsg(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+	va_end(ap);
+	E.statusmsg_time = time(NULL);
+}
+
+void editorRowInsertChar(int at, int col, int c) {
+	editorIndexRowChanged(at);
+	erow *row = editorRowWrite(at);
+	char seq[4];
+	int n = utf8Encode(c, seq);
+	if(col < 0 || col > row->size) col = row->size;
+	row->chars = memRealloc(MEM_TEXT, row->chars, row->size + n + 1);
+	memmove(&row->chars[col + n], &row->chars[col], row->size - col + 1);
+	row->size += n;
+	memcpy(&row->chars[col], seq, n);
+	editorRowChanged(at);
+	E.dirty++;
+}
+
+void editorRowAppendString(int at, char *s, size_t len) {
+	editorIndexRowChanged(at);
+	erow *row = editorRowWrite(at);
+	row->chars = memRealloc(MEM_TEXT, row->chars, row->size + len + 1);
+	memcpy(&row->chars[row->size], s, len);
+	row->size += len;
+	row->chars[row->size] = '\0';
+	editorRowChanged(at);
+	E.dirty++;
+}
+
+void editorInsertChar(int isundoredo, int c) {
+	if(E.cy == E.numrows) {
+		if(isundoredo)
+			editorUndoRecord(UNDO_INSERT, '\n', 0, E.cy);
+		editorInsertRow(E.numrows, "", 0);
+	}
+	if(isundoredo)
+		editorUndoRecord(UNDO_INSERT, c, E.cx, E.cy);
+	char seq[4];
+	editorRowAt(E.cy);
+	editorRowInsertChar(E.cy, E.cx, c);
+	E.cx += utf8Encode(c, seq);
+}
+
+void editorInsertNewline(int isundoredo) {
+	if(isundoredo)
+		editorUndoRecord(UNDO_INSERT, '\n', E.cx, E.cy);
+	if (E.cx == 0) {
+		editorInsertRow(E.cy, "", 0);
+	}
+	else {
+		erow *row = editorRowAt(E.cy);
+		editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
+		editorIndexRowChanged(E.cy);
+		row = editorRowWrite(E.cy);
+		row->size = E.cx;
+		row->chars[row->size] = '\0';
+		editorRowChanged(E.cy);
+	}
+	E.cy++;
+	E.cx = 0;
+}
+
+void editorRowDelChar(int at, int col) {
+	erow *row = editorRow(at);
+	if(col < 0 || col >= row->size) return;
+	editorIndexRowChanged(at);
+	row = editorRowWrite(at);
+	int cp;
+	int n = utf8Decode(&row->chars[col], row->size - col, &cp);
+	memmove(&row->chars[col], &row->chars[col + n], row->size - col - n + 1);
+	row->size -= n;
+	editorRowChanged(at);
+	E.dirty++;
+}
+
+void editorDelChar(int isundoredo) {
+	if(E.cx == 0 && E.cy == 0) return;
+	if(E.cy == E.numrows) {
+		if(E.cy == 0) return;
+		E.cx = editorRow(E.cy - 1)->size;
+		E.cy--;
+		return;
+	}
+
+	erow *row = editorRowAt(E.cy);
+	if(E.cx > 0) {
+		int at = editorRowPrevCp(row, E.cx);
+		if(isundoredo) {
+			int cp;
+			utf8Decode(&row->chars[at], row->size - at, &cp);
+			editorUndoRecord(UNDO_DELETE, cp, at, E.cy);
+		}
+		editorRowDelChar(E.cy, at);
+		E.cx = at;
+	}
+	else {
+	    if(isundoredo)
+    		editorUndoRecord(UNDO_DELETE, '\n', editorRow(E.cy - 1)->size, E.cy - 1);
+	    E.cx = editorRow(E.cy - 1)->size;
+	    editorRowAt(E.cy - 1);
+	    editorRowAppendString(E.cy - 1, row->chars, row->size);
+	    editorDelRow(E.cy);
+	    E.cy--;
+	}
+}
+
+char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
+	size_t bufsize = 128;
+	char *buf = malloc(bufsize);
+	size_t buflen = 0;
+	buf[0] = '\0';
+	while(1) {
+		editorSetStatusMsg(prompt, buf);
+		editorRefreshScreen();
+		editorIdle();
+		int c = getch();
+		if(c == ERR) {
+			editorSaveTick();
+			continue;
+		}
+		if(c == KEY_DC || c == ctrl('h') || c == KEY_BACKSPACE) {
+			while(buflen != 0 && ((unsigned char)buf[--buflen] & 0xC0) == 0x80);
+			buf[buflen] = '\0';
+		}
+		else if(c == 27) {
+			editorSetStatusMsg("");
+			if(callback) callback(buf, c);
+			free(buf);
+			return NULL;
+		}
+		else if(c == 10) {
+			if (buflen != 0) {
+			  editorSetStatusMsg("");
+			  if(callback) callback(buf, c);
+			  return buf;
+			}
+		}
+		else if((!iscntrl(c) && c < 128) || (c >= 0x80 && c <= 0xFF)) {
+			if(buflen == bufsize - 1) {
+				bufsize *= 2;
+				buf = realloc(buf, bufsize);
+			}
+			buf[buflen++] = c;
+			buf[buflen] = '\0';
+		}
+		if(callback) callback(buf, c);
+	}
+}
+
+int isPrintable(int c) {
+	return (c == '\t' || (c >= 32 && c <= 126) || (c >= 0xA0 && iswprint(c)));
+}
+
+void editorMoveCursor(int c) {
+	erow *row = (E.cy >= E.numrows) ? NULL : editorRowAt(E.cy);
+	switch(c) {
+		case KEY_LEFT:
+			if(E.cx != 0) E.cx = editorRowPrevCx(row, E.cx);
+			else if(E.cy > 0) {
+				E.cy--;
+				E.cx = editorRow(E.cy)->size;
+			}
+			break;
+		case KEY_RIGHT:
+			if(row && E.cx < row->size) E.cx = editorRowNextCx(row, E.cx);
+			else if(row && E.cx == row->size) {
+				E.cy++;
+				E.cx = 0;
+			}
+			break;
+		case KEY_UP:
+			if(E.cy != 0) E.cy--;
+			break;
+		case KEY_DOWN:
+			if(E.cy < E.numrows) E.cy++;
+			break;
+		case KEY_HOME:
+			E.cx = 0;
+			break;
+		case KEY_END:
+			if(E.cy < E.numrows) E.cx = editorRow(E.cy)->size;
+			break;
+		case 338:
+		case 339:
+			int times = E.rows;
+			if(E.softwrap) {
+				int y, x;
+				editorScreenPos(E.cy, E.rx, &y, &x);
+				editorWrapCursor(editorWrapTop() + (c == 338 ? 2 * E.rows - 1 : -E.rows), x);
+				break;
+			}
+			if(c == 339) {
+				E.cy = E.rowoff;
+				while(times--)
+					if(E.cy != 0) E.cy--;
+				break;
+			}
+			else if(c == 338) {
+				E.cy = E.rowoff + E.rows - 1;
+				if(E.cy > E.numrows) E.cy = E.numrows;
+				while(times--)
+					if(E.cy < E.numrows) E.cy++;
+				break;
+			}
+			break;
+	}
+}
+
+void editorProcessKeypress(int c) {
+	MEVENT event;
+	static int quit_times = QUIT_TIMES;
+	erow *row = (E.cy >= E.numrows) ? NULL : editorRowAt(E.cy);
+	if(E.pager) {
+		pagerProcessKeypress(c);
+		return;
+	}
+
+	switch(c) {
+		case ctrl('q'):
+			if(E.dirty && quit_times > 0) {
+				editorSetStatusMsg("Unsaved file. Press Ctrl-Q once more to quit");
+				quit_times--;
+				return;
+			}
+			editorSaveFlush();
+			sessionSave();
+			if(!E.dirty && E.filename && !E.pager) {
+				char *autosave = editorAutosavePath(E.filename);
+				unlink(autosave);
+				free(autosave);
+			}
+			endwin();
+			exit(0);
+			break;
+		case ctrl('s'):
+			editorSave();
+			break;
+		case ctrl('z'):
+			editorUndo();
+			break;
+		case ctrl('y'):
+			editorRedo();
+			break;
+		case ctrl('r'):
+			editorRevision();
+			break;
+		case ctrl('n'):
+			editorComplete();
+			break;
+		case ctrl('t'):
+			editorJump();
+			break;
+		case ctrl(']'):
+			editorMatchBracket();
+			break;
+		case ctrl('d'):
+			diffToggle();
+			break;
+		case ctrl('b'):
+			editorToggleMark();
+			break;
+		case ctrl('w'):
+			E.softwrap = !E.softwrap;
+			E.wrapoff = 0;
+			editorSetStatusMsg("Soft wrap %s", E.softwrap ? "on" : "off");
+			break;
+		case KEY_HOME:
+			editorMoveCursor(c);
+			break;
+		case KEY_END:
+			editorMoveCursor(c);
+			break;
+		case 338:
+		case 339:
+			editorMoveCursor(c);
+				break;
+		case ctrl('f'):
+			editorFind();
+			break;
+		case ctrl('g'):
+			editorGoto();
+			break;
+		case KEY_ENTER:
+		case ctrl('j'):
+			editorInsertNewline(1);
+			break;
+		case KEY_BACKSPACE:
+		case ctrl('h'):
+		case KEY_DC:
+			if(c == KEY_DC) {
+				if(row && E.cx < row->size) {
+					int cp;
+					E.cx += utf8Decode(&row->chars[E.cx], row->size - E.cx, &cp);
+				}
+				else if(row && E.cx == row->size) {
+					E.cy++;
+					E.cx = 0;
+				}
+			}
+			editorDelChar(1);
+			break;
+		case KEY_LEFT:
+			editorMoveCursor(c);
+			break;
+		case KEY_RIGHT:
+			editorMoveCursor(c);
+			break;
+		case KEY_UP:
+			editorMoveCursor(c);
+			break;
+		case KEY_DOWN:
+			editorMoveCursor(c);
+			break;
+		case 27:
+			int ch = getch();
+			if(ch == -1) break;
+			else {
+				switch(ch) {
+					case 'j': editorMoveCursor(KEY_UP); break;
+					case 'h': editorMoveCursor(KEY_LEFT); break;
+					case 'k': editorMoveCursor(KEY_DOWN); break;
+					case 'l': editorMoveCursor(KEY_RIGHT); break;
+					case 'n': editorMoveCursor(KEY_HOME); break;
+					case 'm': editorMoveCursor(KEY_END); break;
+					case '.': diffJump(1); break;
+					case ',': diffJump(-1); break;
+					case '|': editorFilter(); break;
+					case 'u': memReport(); break;
+				}
+			}
+			break;
+		case KEY_MOUSE:
+			if(c == KEY_MOUSE) {
+				if(getmouse(&event) == OK) {
+					if(event.bstate & BUTTON4_PRESSED)
+						editorMoveCursor(KEY_UP);
+					else if(event.bstate & BUTTON5_PRESSED)
+						editorMoveCursor(KEY_DOWN);
+					else if(E.softwrap) {
+						long long v = editorWrapTop() + event.y;
+						if(v < fenwickPrefix(editorWrapIndex(), E.numrows))
+							editorWrapCursor(v, event.x - E.line_width - 1);
+					}
+					else if(event.y + E.rowoff < E.numrows) {
+						E.cy = event.y + E.rowoff;
+						E.rx = event.x + E.line_width;
+						E.cx = editorRowRxToCx(editorRowAt(E.cy), event.x - E.line_width - 1);
+					}
+				}
+			}
+			break;
+		default:
+			if(c >= 0x80 && c <= 0xFF)
+				c = editorReadUtf8(c);
+			else if(c > 0xFF)
+				break;
+			if(isPrintable(c))
+				editorInsertChar(1, c);
+			break;
+	}
+
+	row = (E.cy >= E.numrows) ? NULL : editorRowAt(E.cy);
+	int rowlen = row ? row->size : 0;
+	if(E.cx > rowlen)
+		E.cx = rowlen;
+	if(row)
+		E.cx = editorRowSnapCx(row, E.cx);
+
+	quit_times = QUIT_TIMES;
+}
+
+void getWindowSize(int *rows, int *cols) {
+	getmaxyx(stdscr, *cols, *rows);
+	E.rows -= 2;
+}
+
+void initEditor() {
+	E.cx = 0;
+	E.cy = 0;
+	E.rx = 0;
+	E.rowoff = 0;
+	E.numrows = 0;
+	E.line_width = 0;
+	E.coloff = 0;
+	memset(&E.row, 0, sizeof(rowtable));
+	E.dirty = 0;
+	E.filename = NULL;
+	E.statusmsg[0] = '\0';
+	E.statusmsg_time = 0;
+	E.undo.root = E.undo.cur = NULL;
+	E.undo.nodes = E.undo.checks = NULL;
+	E.undo.numnodes = E.undo.numchecks = 0;
+	E.undo.compacted = 0;
+	memset(&E.index, 0, sizeof(wordindex));
+	memset(&E.brackets, 0, sizeof(brackettree));
+	memset(&E.diff, 0, sizeof(diffstate));
+	E.diff.enabled = 1;
+	E.diff.lo = 1;
+	E.coldenabled = 0;
+	E.tick = 0;
+	E.coldscan = 0;
+	E.coldblk = NULL;
+	E.coldbuf = NULL;
+	memset(&E.bytes, 0, sizeof(fenwick));
+	memset(&E.wrap, 0, sizeof(fenwick));
+	E.mark = -1;
+	E.softwrap = 0;
+	E.wrapcols = 0;
+	E.wrapoff = 0;
+	E.gen = 0;
+	E.snapgen = -1;
+	E.snaps = NULL;
+	E.graves = NULL;
+	E.numgraves = 0;
+	E.pager = NULL;
+	E.save.snap = NULL;
+	E.save.path = NULL;
+	E.save.done = 0;
+	E.save.pending = 0;
+	E.save.interval = AUTOSAVE_INTERVAL;
+	E.save.lastdirty = 0;
+	E.save.last = time(NULL);
+	pthread_mutex_init(&E.save.lock, NULL);
+	pthread_cond_init(&E.save.cond, NULL);
+	if(pthread_create(&E.save.thread, NULL, editorSaveThread, &E.save) != 0) die("pthread_create");
+	setlocale(LC_ALL, "");
+	initscr();
+	start_color();
+	clear();
+	raw();
+	keypad(stdscr, TRUE);
+	noecho();
+	scrollok(stdscr, FALSE);
+	timeout(SAVE_POLL_MS);
+	mousemask(ALL_MOUSE_EVENTS, NULL);
+
+	init_color(COLOR_CYAN, 188, 188, 211);
+	init_color(COLOR_RED, 1000, 0, 0);
+	init_color(COLOR_BLUE, 188, 737, 929);
+
+	init_pair(1, COLOR_BLACK, COLOR_WHITE);
+	init_pair(2, COLOR_BLUE, COLOR_CYAN);
+	init_pair(3, COLOR_YELLOW, COLOR_CYAN);
+	init_pair(4, COLOR_GREEN, COLOR_CYAN);
+	init_pair(5, COLOR_WHITE, COLOR_CYAN);
+	init_pair(6, COLOR_RED, COLOR_CYAN);
+	init_pair(10, COLOR_WHITE, COLOR_CYAN);
+
+	bkgd(COLOR_PAIR(10));
+	if(E.vt.enabled) refresh();
+	getWindowSize(&E.cols, &E.rows);
+}
+
+void editorUpdateRow(erow *row) {
+	int tabs = 0;
+	for(int j = 0; j < row->size; j++)
+		if(row->chars[j] == '\t') tabs++;
+
+	memFree(MEM_RENDER, row->render);
+	memFree(MEM_RENDER, row->hl);
+	row->hl = NULL;
+	row->render = memAlloc(MEM_RENDER, row->size + tabs * (TAB_STOP - 1) + 1);
+	row->ascii = editorIsAscii(row->chars, row->size);
+
+	int idx = editorRenderTabs(row->chars, row->size, row->ascii, 0, row->render);
+	row->render[idx] = '\0';
+	row->rsize = idx;
+	row->wrapw = idx;
+	row->wrapwide = 0;
+	if(!row->ascii) {
+		row->wrapw = 0;
+		for(int j = 0, n, cp, w; j < idx; j += n) {
+			n = utf8Decode(&row->render[j], idx - j, &cp);
+			w = utf8Width(cp);
+			if(w > 1) row->wrapwide = 1;
+			row->wrapw += w;
+		}
+	}
+}
+
+void editorRowChanged(int at) {
+	erow *row = editorRow(at);
+	editorUpdateRow(row);
+	if(E.bytes.valid)
+		fenwickSet(&E.bytes, at, row->size + 1);
+	if(E.wrap.valid)
+		fenwickSet(&E.wrap, at, editorRowVisual(at));
+	bracketRowChanged(at);
+	diffRowChanged(at);
+}
+
+int editorRenderTabs(const char *s, int len, int ascii, int col, char *out) {
+	int idx = 0;
+	if(ascii) {
+		for(int j = 0; j < len; j++) {
+			if(s[j] == '\t') {
+				out[idx++] = ' ';
+				while((col + idx) % TAB_STOP != 0) out[idx++] = ' ';
+			}
+			else {
+				out[idx++] = s[j];
+			}
+		}
+		return idx;
+	}
+	int cp, n;
+	for(int j = 0; j < len; j += n) {
+		if(s[j] == '\t') {
+			n = 1;
+			do {
+				out[idx++] = ' ';
+				col++;
+			} while(col % TAB_STOP != 0);
+			continue;
+		}
+		n = utf8Decode(&s[j], len - j, &cp);
+		col += utf8Width(cp);
+		memcpy(&out[idx], &s[j], n);
+		idx += n;
+	}
+	return idx;
+}
+
+void editorInsertRow(int at, char *s, size_t len) {
+	if(at < 0 || at > E.numrows) return;
+	erow row;
+	row.size = len;
+	row.chars = memAlloc(MEM_TEXT, len + 1);
+	memcpy(row.chars, s, len);
+	row.chars[len] = '\0';
+
+	row.rsize = 0;
+	row.render = NULL;
+	row.hl = NULL;
+	row.cold = NULL;
+	row.gen = E.gen;
+	row.indexed = 0;
+	row.stamp = E.tick;
+	row.hashed = 0;
+	row.diff = DIFF_SAME;
+	row.disk = -1;
+	editorUpdateRow(&row);
+	editorRowsSplice(at, 0, &row, 1);
+	if(E.bytes.valid)
+		fenwickInsert(&E.bytes, at, len + 1);
+	if(E.wrap.valid)
+		fenwickInsert(&E.wrap, at, editorRowVisual(at));
+	if(E.mark >= at) E.mark++;
+	bracketRowInserted(at);
+
+	E.numrows++;
+	diffRowInserted(at);
+	editorIndexRowInserted(at);
+	E.dirty++;
+}
+
+void editorFreeRow(erow *row) {
+	if(row->gen <= E.snapgen) {
+		editorGrave(row->cold ? (void *)row->cold : (void *)row->chars, row->cold ? GRAVE_COLD : GRAVE_TEXT, row->gen);
+		if(!row->cold) {
+			memFree(MEM_RENDER, row->render);
+			memFree(MEM_RENDER, row->hl);
+		}
+		return;
+	}
+	if(row->cold) {
+		coldBlockRelease(row->cold);
+		return;
+	}
+	memFree(MEM_RENDER, row->render);
+	memFree(MEM_RENDER, row->hl);
+	memFree(MEM_TEXT, row->chars);
+}
+
+void editorDelRow(int at) {
+	if (at < 0 || at >= E.numrows) return;
+	editorIndexRowDeleted(at);
+	editorFreeRow(editorRow(at));
+	editorRowsSplice(at, 1, NULL, 0);
+	E.numrows--;
+	if(E.mark >= at && (E.mark > 0 || E.numrows == 0)) E.mark--;
+	bracketRowDeleted(at);
+	diffRowDeleted(at);
+	if(E.bytes.valid)
+		fenwickDelete(&E.bytes, at);
+	if(E.wrap.valid)
+		fenwickDelete(&E.wrap, at);
+	E.dirty++;
+}
+
+int coldCompress(const char *src, int len, char *dst) {
+	int table[1 << COLD_HASH_BITS];
+	const unsigned char *in = (const unsigned char *)src;
+	unsigned char *out = (unsigned char *)dst;
+	int op = 0, anchor = 0, i = 0;
+
+	memset(table, -1, sizeof(table));
+	while(i + 4 <= len) {
+		uint32_t seq;
+		memcpy(&seq, &in[i], 4);
+		int h = (seq * 2654435761U) >> (32 - COLD_HASH_BITS);
+		int ref = table[h];
+		table[h] = i;
+		if(ref < 0 || i - ref > 0xFFFF || memcmp(&in[ref], &in[i], 4) != 0) {
+			i++;
+			continue;
+		}
+		int mlen = 4;
+		while(i + mlen < len && in[ref + mlen] == in[i + mlen])
+			mlen++;
+
+		int lit = i - anchor;
+		int m = mlen - 4;
+		out[op++] = ((lit < 15 ? lit : 15) << 4) | (m < 15 ? m : 15);
+		if(lit >= 15) {
+			for(lit -= 15; lit >= 255; lit -= 255) out[op++] = 255;
+			out[op++] = lit;
+		}
+		memcpy(&out[op], &in[anchor], i - anchor);
+		op += i - anchor;
+		out[op++] = (i - ref) & 0xFF;
+		out[op++] = (i - ref) >> 8;
+		if(m >= 15) {
+			for(m -= 15; m >= 255; m -= 255) out[op++] = 255;
+			out[op++] = m;
+		}
+		i += mlen;
+		anchor = i;
+		if(op > len) return -1;
+	}
+
+	int lit = len - anchor;
+	out[op++] = (lit < 15 ? lit : 15) << 4;
+	if(lit >= 15) {
+		for(lit -= 15; lit >= 255; lit -= 255) out[op++] = 255;
+		out[op++] = lit;
+	}
+	if(op + len - anchor >= len) return -1;
+	memcpy(&out[op], &in[anchor], len - anchor);
+	return op + len - anchor;
+}
+
+int coldDecompress(const char *src, int clen, char *dst, int len) {
+	const unsigned char *in = (const unsigned char *)src;
+	int ip = 0, op = 0;
+
+	while(ip < clen) {
+		int token = in[ip++];
+		int lit = token >> 4;
+		if(lit == 15) {
+			while(ip < clen && in[ip] == 255) lit += in[ip++];
+			if(ip < clen) lit += in[ip++];
+		}
+		if(ip + lit > clen || op + lit > len) return -1;
+		memcpy(&dst[op], &in[ip], lit);
+		ip += lit;
+		op += lit;
+		if(ip == clen) break;
+
+		if(ip + 2 > clen) return -1;
+		int off = in[ip] | (in[ip + 1] << 8);
+		ip += 2;
+		int mlen = (token & 15);
+		if(mlen == 15) {
+			while(ip < clen && in[ip] == 255) mlen += in[ip++];
+			if(ip < clen) mlen += in[ip++];
+		}
+		mlen += 4;
+		if(off == 0 || off > op || op + mlen > len) return -1;
+		for(int k = 0; k < mlen; k++, op++)
+			dst[op] = dst[op - off];
+	}
+	return op == len ? 0 : -1;
+}
+
+const char *coldBlockDataInto(coldblock *blk, coldblock **cacheblk, char **cachebuf) {
+	if(blk->clen == blk->len) return blk->data;
+	if(*cacheblk == blk) return *cachebuf;
+	*cachebuf = realloc(*cachebuf, blk->len ? blk->len : 1);
+	if(coldDecompress(blk->data, blk->clen, *cachebuf, blk->len) == -1) die("coldDecompress");
+	*cacheblk = blk;
+	return *cachebuf;
+}
+
+const char *coldBlockData(coldblock *blk) {
+	return coldBlockDataInto(blk, &E.coldblk, &E.coldbuf);
+}
+
+void coldBlockRelease(coldblock *blk) {
+	if(--blk->refs > 0) return;
+	if(E.coldblk == blk) E.coldblk = NULL;
+	memFree(MEM_COLD, blk->data);
+	memFree(MEM_COLD, blk);
+}
+
+void editorFreezeRows(int from, int to) {
+	int len = 0;
+	for(int i = from; i < to; i++)
+		len += editorRow(i)->size;
+
+	char *raw = malloc(len ? len : 1);
+	char *p = raw;
+	for(int i = from; i < to; i++) {
+		erow *row = editorRow(i);
+		memcpy(p, row->chars, row->size);
+		p += row->size;
+	}
+
+	coldblock *blk = memAlloc(MEM_COLD, sizeof(coldblock));
+	blk->data = memAlloc(MEM_COLD, len + len / 255 + 16);
+	blk->clen = coldCompress(raw, len, blk->data);
+	if(blk->clen == -1) {
+		memcpy(blk->data, raw, len);
+		blk->clen = len;
+	}
+	else {
+		blk->data = memRealloc(MEM_COLD, blk->data, blk->clen ? blk->clen : 1);
+	}
+	blk->len = len;
+	blk->refs = to - from;
+	free(raw);
+
+	int off = 0;
+	for(int i = from; i < to; i++) {
+		erow *row = editorRowUnshare(i);
+		if(row->gen <= E.snapgen)
+			editorGrave(row->chars, GRAVE_TEXT, row->gen);
+		else
+			memFree(MEM_TEXT, row->chars);
+		memFree(MEM_RENDER, row->render);
+		memFree(MEM_RENDER, row->hl);
+		row->chars = row->render = NULL;
+		row->hl = NULL;
+		row->cold = blk;
+		row->coldoff = off;
+		row->gen = E.gen;
+		off += row->size;
+	}
+}
+
+void editorRowThaw(erow *row) {
+	coldblock *blk = row->cold;
+	const char *data = coldBlockData(blk);
+	row->chars = memAlloc(MEM_TEXT, row->size + 1);
+	memcpy(row->chars, &data[row->coldoff], row->size);
+	row->chars[row->size] = '\0';
+	row->cold = NULL;
+	if(row->gen <= E.snapgen)
+		editorGrave(blk, GRAVE_COLD, row->gen);
+	else
+		coldBlockRelease(blk);
+	row->gen = E.gen;
+	editorUpdateRow(row);
+}
+
+erow *editorRowAt(int at) {
+	erow *row = editorRow(at);
+	if(row->cold) {
+		row = editorRowWrite(at);
+		editorRowThaw(row);
+	}
+	else if(!row->render) {
+		editorUpdateRow(row);
+	}
+	row->stamp = E.tick;
+	return row;
+}
+
+void editorUpdateSyntax(erow *row) {
+	memFree(MEM_RENDER, row->hl);
+	row->hl = memAlloc(MEM_RENDER, row->rsize + 1);
+	highlight_buffer(row->render, row->rsize, row->hl);
+}
+
+erow *editorRowSyntax(int at) {
+	erow *row = editorRowAt(at);
+	if(!row->hl)
+		editorUpdateSyntax(row);
+	return row;
+}
+
+const char *editorRowPeek(int at, int *len) {
+	erow *row = editorRow(at);
+	*len = row->size;
+	if(row->cold)
+		return &coldBlockData(row->cold)[row->coldoff];
+	return row->chars;
+}
+
+void editorColdTick() {
+	E.tick++;
+	if(!E.coldenabled || E.numrows == 0) return;
+	if(E.coldscan >= E.numrows) E.coldscan = 0;
+
+	int end = E.coldscan + COLD_SCAN_ROWS;
+	if(end > E.numrows) end = E.numrows;
+	editorColdSweep(E.coldscan, end, 0);
+	E.coldscan = end;
+}
+
+void editorColdSweep(int start, int end, int force) {
+	int from = -1, bytes = 0;
+	for(int i = start; i <= end; i++) {
+		erow *row = i < end ? editorRow(i) : NULL;
+		int eligible = row && !row->cold && (force || E.tick - row->stamp > COLD_AGE) &&
+			(i < E.rowoff - E.rows || i >= E.rowoff + 2 * E.rows);
+		if(eligible) {
+			if(from == -1) from = i;
+			bytes += row->size;
+		}
+		if(from != -1 && (!eligible || bytes >= COLD_BLOCK_BYTES)) {
+			int to = eligible ? i + 1 : i;
+			if(to - from > 1) editorFreezeRows(from, to);
+			from = -1;
+			bytes = 0;
+		}
+	}
+}
+
+snapshot *snapshotCapture() {
+	snapshot *snap = memAlloc(MEM_ROWS, sizeof(snapshot));
+	rowtable *t = &snap->row;
+	t->numchunks = E.row.numchunks;
+	t->chunk = memAlloc(MEM_ROWS, sizeof(rowchunk *) * (t->numchunks + 1));
+	t->start = memAlloc(MEM_ROWS, sizeof(int) * (t->numchunks + 1));
+	if(t->numchunks) {
+		memcpy(t->chunk, E.row.chunk, sizeof(rowchunk *) * t->numchunks);
+		memcpy(t->start, E.row.start, sizeof(int) * t->numchunks);
+	}
+	t->hint = 0;
+	snap->numrows = E.numrows;
+	snap->gen = E.gen++;
+	snap->next = E.snaps;
+	E.snaps = snap;
+	E.snapgen = snap->gen;
+	return snap;
+}
+
+void snapshotRelease(snapshot *s) {
+	snapshot **pp = &E.snaps;
+	while(*pp != s) pp = &(*pp)->next;
+	*pp = s->next;
+
+	E.snapgen = -1;
+	for(snapshot *t = E.snaps; t; t = t->next)
+		if(t->gen > E.snapgen) E.snapgen = t->gen;
+	rowtableFree(&s->row);
+	memFree(MEM_ROWS, s);
+	editorGraveSweep();
+}
+
+long long snapshotWrite(snapshot *s, int fd) {
+	char buf[COLD_BLOCK_BYTES];
+	coldblock *cacheblk = NULL;
+	char *cachebuf = NULL;
+	int used = 0;
+	long long total = 0;
+	for(int i = 0; i < s->numrows; i++) {
+		erow *row = rowtableAt(&s->row, i);
+		int len = row->size;
+		const char *chars = row->chars;
+		if(row->cold)
+			chars = &coldBlockDataInto(row->cold, &cacheblk, &cachebuf)[row->coldoff];
+		while(len + 1 > COLD_BLOCK_BYTES - used) {
+			int n = COLD_BLOCK_BYTES - used;
+			if(n > len) n = len;
+			memcpy(&buf[used], chars, n);
+			used += n;
+			chars += n;
+			len -= n;
+			if(write(fd, buf, used) != used) {
+				free(cachebuf);
+				return -1;
+			}
+			total += used;
+			used = 0;
+		}
+		memcpy(&buf[used], chars, len);
+		used += len;
+		buf[used++] = '\n';
+	}
+	free(cachebuf);
+	if(used && write(fd, buf, used) != used) return -1;
+	return total + used;
+}
+
+int rowtableLocate(rowtable *t, int at, int *off) {
+	int c = t->hint;
+	if(t->numchunks == 0) {
+		*off = at;
+		return 0;
+	}
+	if(c >= t->numchunks || at < t->start[c] || at >= t->start[c] + t->chunk[c]->n) {
+		int lo = 0, hi = t->numchunks - 1;
+		while(lo < hi) {
+			int mid = (lo + hi + 1) / 2;
+			if(t->start[mid] <= at) lo = mid;
+			else hi = mid - 1;
+		}
+		c = lo;
+		t->hint = c;
+	}
+	*off = at - t->start[c];
+	return c;
+}
+
+erow *rowtableAt(rowtable *t, int at) {
+	int off, c = rowtableLocate(t, at, &off);
+	return &t->chunk[c]->row[off];
+}
+
+void rowtableResize(rowtable *t, int numchunks) {
+	t->chunk = memRealloc(MEM_ROWS, t->chunk, sizeof(rowchunk *) * (numchunks + 1));
+	t->start = memRealloc(MEM_ROWS, t->start, sizeof(int) * (numchunks + 1));
+}
+
+void rowtableRenumber(rowtable *t, int from) {
+	int start = from > 0 ? t->start[from - 1] + t->chunk[from - 1]->n : 0;
+	for(int c = from; c < t->numchunks; c++) {
+		t->start[c] = start;
+		start += t->chunk[c]->n;
+	}
+}
+
+void rowtableFree(rowtable *t) {
+	memFree(MEM_ROWS, t->chunk);
+	memFree(MEM_ROWS, t->start);
+	memset(t, 0, sizeof(rowtable));
+}
+
+rowchunk *editorChunkNew() {
+	rowchunk *chunk = memAlloc(MEM_ROWS, sizeof(rowchunk));
+	chunk->n = 0;
+	chunk->gen = E.gen;
+	return chunk;
+}
+
+void editorChunkFree(rowchunk *chunk) {
+	if(chunk->gen <= E.snapgen)
+		editorGrave(chunk, GRAVE_ROWS, chunk->gen);
+	else
+		memFree(MEM_ROWS, chunk);
+}
+
+rowchunk *editorChunkOwn(int c) {
+	rowchunk *chunk = E.row.chunk[c];
+	if(chunk->gen > E.snapgen) return chunk;
+	rowchunk *copy = editorChunkNew();
+	copy->n = chunk->n;
+	memcpy(copy->row, chunk->row, sizeof(erow) * chunk->n);
+	editorChunkFree(chunk);
+	E.row.chunk[c] = copy;
+	return copy;
+}
+
+void editorChunkRemove(int c, int count) {
+	rowtable *t = &E.row;
+	for(int k = c; k < c + count; k++)
+		editorChunkFree(t->chunk[k]);
+	memmove(&t->chunk[c], &t->chunk[c + count], sizeof(rowchunk *) * (t->numchunks - c - count));
+	t->numchunks -= count;
+	rowtableRenumber(t, c);
+}
+
+erow *editorRow(int at) {
+	return rowtableAt(&E.row, at);
+}
+
+erow *editorRowUnshare(int at) {
+	int off, c = rowtableLocate(&E.row, at, &off);
+	return &editorChunkOwn(c)->row[off];
+}
+
+int editorRowsSplit(int at) {
+	rowtable *t = &E.row;
+	int off, c = rowtableLocate(t, at, &off);
+	if(t->numchunks == 0 || off == 0) return c;
+	if(off == t->chunk[c]->n) return c + 1;
+	rowchunk *chunk = editorChunkOwn(c), *tail = editorChunkNew();
+	tail->n = chunk->n - off;
+	memcpy(tail->row, &chunk->row[off], sizeof(erow) * tail->n);
+	chunk->n = off;
+	rowtableResize(t, t->numchunks + 1);
+	memmove(&t->chunk[c + 2], &t->chunk[c + 1], sizeof(rowchunk *) * (t->numchunks - c - 1));
+	t->chunk[c + 1] = tail;
+	t->numchunks++;
+	rowtableRenumber(t, c + 1);
+	return c + 1;
+}
+
+void editorRowsMerge(int c) {
+	rowtable *t = &E.row;
+	if(c <= 0 || c >= t->numchunks) return;
+	if(t->chunk[c - 1]->n + t->chunk[c]->n > ROW_CHUNK / 2) return;
+	rowchunk *prev = editorChunkOwn(c - 1);
+	memcpy(&prev->row[prev->n], t->chunk[c]->row, sizeof(erow) * t->chunk[c]->n);
+	prev->n += t->chunk[c]->n;
+	editorChunkRemove(c, 1);
+}
+
+void editorRowsSplice(int at, int del, erow *rows, int ins) {
+	rowtable *t = &E.row;
+	int off, c = rowtableLocate(t, at, &off);
+	if(t->numchunks > 0 && off + del <= t->chunk[c]->n) {
+		int n = t->chunk[c]->n;
+		if(n - del + ins > ROW_CHUNK && ins <= ROW_CHUNK / 2 && off > 0 && off < n) {
+			editorRowsSplit(t->start[c] + n / 2);
+			editorRowsSplice(at, del, rows, ins);
+			return;
+		}
+		if(n - del + ins <= ROW_CHUNK) {
+			rowchunk *chunk = editorChunkOwn(c);
+			memmove(&chunk->row[off + ins], &chunk->row[off + del], sizeof(erow) * (n - off - del));
+			if(ins) memcpy(&chunk->row[off], rows, sizeof(erow) * ins);
+			chunk->n += ins - del;
+			if(chunk->n == 0) {
+				editorChunkRemove(c, 1);
+				return;
+			}
+			for(int k = c + 1; k < t->numchunks; k++)
+				t->start[k] += ins - del;
+			if(ins < del) {
+				editorRowsMerge(c + 1);
+				editorRowsMerge(c);
+			}
+			return;
+		}
+	}
+	int first = editorRowsSplit(at);
+	int last = editorRowsSplit(at + del);
+	int add = (ins + ROW_CHUNK - 1) / ROW_CHUNK;
+	for(int k = first; k < last; k++)
+		editorChunkFree(t->chunk[k]);
+	rowtableResize(t, t->numchunks + add);
+	memmove(&t->chunk[first + add], &t->chunk[last], sizeof(rowchunk *) * (t->numchunks - last));
+	for(int k = 0; k < add; k++) {
+		rowchunk *chunk = editorChunkNew();
+		chunk->n = ins - k * ROW_CHUNK < ROW_CHUNK ? ins - k * ROW_CHUNK : ROW_CHUNK;
+		memcpy(chunk->row, &rows[k * ROW_CHUNK], sizeof(erow) * chunk->n);
+		t->chunk[first + k] = chunk;
+	}
+	t->numchunks += add - (last - first);
+	rowtableRenumber(t, first);
+	editorRowsMerge(first + add);
+	editorRowsMerge(first);
+}
+
+void editorRowsFree() {
+	for(int c = 0; c < E.row.numchunks; c++)
+		editorChunkFree(E.row.chunk[c]);
+	rowtableFree(&E.row);
+}
+
+erow *editorRowWrite(int at) {
+	erow *row = editorRowUnshare(at);
+	if(!row->cold && row->gen <= E.snapgen) {
+		char *chars = memAlloc(MEM_TEXT, row->size + 1);
+		memcpy(chars, row->chars, row->size + 1);
+		editorGrave(row->chars, GRAVE_TEXT, row->gen);
+		row->chars = chars;
+		row->gen = E.gen;
+	}
+	return row;
+}
+
+void editorGrave(void *ptr, int kind, int birth) {
+	if(E.numgraves % 64 == 0)
+		E.graves = memRealloc(MEM_ROWS, E.graves, sizeof(grave) * (E.numgraves + 64));
+	grave *g = &E.graves[E.numgraves++];
+	g->ptr = ptr;
+	g->kind = kind;
+	g->birth = birth;
+	g->death = E.gen;
+}
+
+void editorGraveSweep() {
+	int kept = 0;
+	for(int i = 0; i < E.numgraves; i++) {
+		grave *g = &E.graves[i];
+		int live = 0;
+		for(snapshot *t = E.snaps; t && !live; t = t->next)
+			live = (g->birth <= t->gen && t->gen < g->death);
+		if(live)
+			E.graves[kept++] = *g;
+		else if(g->kind == GRAVE_COLD)
+			coldBlockRelease(g->ptr);
+		else if(g->kind == GRAVE_ROWS)
+			memFree(MEM_ROWS, g->ptr);
+		else
+			memFree(MEM_TEXT, g->ptr);
+	}
+	E.numgraves = kept;
+}
+
+void *editorSaveThread(void *arg) {
+	saver *sv = arg;
+	pthread_mutex_lock(&sv->lock);
+	while(1) {
+		while(sv->snap == NULL || sv->done)
+			pthread_cond_wait(&sv->cond, &sv->lock);
+		snapshot *snap = sv->snap;
+		int manual = sv->manual;
+		char path[strlen(sv->path) + 5];
+		strcpy(path, sv->path);
+		pthread_mutex_unlock(&sv->lock);
+
+		long long written = -1;
+		int err = 0;
+		if(!manual) strcat(path, ".tmp");
+		int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if(fd != -1) {
+			written = snapshotWrite(snap, fd);
+			if(written == -1) err = errno;
+			if(close(fd) == -1 && written != -1) {
+				written = -1;
+				err = errno;
+			}
+			if(!manual && written != -1 && rename(path, sv->path) == -1) {
+				written = -1;
+				err = errno;
+			}
+		}
+		else
+			err = errno;
+
+		pthread_mutex_lock(&sv->lock);
+		sv->written = written;
+		sv->err = err;
+		sv->done = 1;
+	}
+	return NULL;
+}
+
+void editorSaveStart(int manual) {
+	saver *sv = &E.save;
+	free(sv->path);
+	sv->path = manual ? strdup(E.filename) : editorAutosavePath(E.filename);
+	sv->manual = manual;
+	sv->dirty = E.dirty;
+	if(manual) {
+		E.dirty = 0;
+		sv->lastdirty = 0;
+	}
+	else {
+		sv->lastdirty = E.dirty;
+		sv->last = time(NULL);
+	}
+	pthread_mutex_lock(&sv->lock);
+	sv->snap = snapshotCapture();
+	sv->done = 0;
+	pthread_cond_signal(&sv->cond);
+	pthread_mutex_unlock(&sv->lock);
+}
+
+void editorSaveTick() {
+	saver *sv = &E.save;
+	if(sv->snap) {
+		pthread_mutex_lock(&sv->lock);
+		int done = sv->done;
+		pthread_mutex_unlock(&sv->lock);
+		if(!done) return;
+
+		if(sv->manual && sv->written != -1)
+			diffBaseline(sv->snap, sv->path, 1);
+		else
+			snapshotRelease(sv->snap);
+		if(sv->manual) {
+			if(sv->written == -1) {
+				E.dirty += sv->dirty;
+				editorSetStatusMsg("Can't save! I/O error : %s", strerror(sv->err));
+			}
+			else {
+				char *autosave = editorAutosavePath(sv->path);
+				unlink(autosave);
+				free(autosave);
+				editorSetStatusMsg("%lld bytes written to disk", sv->written);
+			}
+		}
+		else if(sv->written == -1) {
+			editorSetStatusMsg("Autosave failed : %s", strerror(sv->err));
+		}
+		pthread_mutex_lock(&sv->lock);
+		sv->snap = NULL;
+		sv->done = 0;
+		pthread_mutex_unlock(&sv->lock);
+	}
+
+	if(sv->pending) {
+		sv->pending = 0;
+		editorSaveStart(1);
+	}
+	else if(sv->interval > 0 && E.filename && E.dirty && E.dirty != sv->lastdirty &&
+			time(NULL) - sv->last >= sv->interval) {
+		editorSaveStart(0);
+	}
+}
+
+void editorSaveFlush() {
+	while(E.save.snap || E.save.pending) {
+		editorSaveTick();
+		usleep(1000);
+	}
+}
+
+char *editorAutosavePath(const char *filename) {
+	char *path = malloc(strlen(filename) + sizeof(AUTOSAVE_SUFFIX));
+	strcpy(path, filename);
+	strcat(path, AUTOSAVE_SUFFIX);
+	return path;
+}
+
+void fenwickFree(fenwick *f) {
+	for(int b = 0; b < f->numblocks; b++)
+		memFree(MEM_INDEX, f->blocks[b]);
+	memFree(MEM_INDEX, f->blocks);
+	memFree(MEM_INDEX, f->tree);
+	memFree(MEM_INDEX, f->count);
+	memset(f, 0, sizeof(fenwick));
+}
+
+void fenwickReindex(fenwick *f) {
+	int n = f->numblocks;
+	f->tree = memRealloc(MEM_INDEX, f->tree, sizeof(long long) * (n + 1));
+	f->count = memRealloc(MEM_INDEX, f->count, sizeof(int) * (n + 1));
+	f->tree[0] = 0;
+	f->count[0] = 0;
+	for(int b = 0; b < n; b++) {
+		f->tree[b + 1] = f->blocks[b]->sum;
+		f->count[b + 1] = f->blocks[b]->n;
+	}
+	for(int i = 1; i <= n; i++) {
+		int j = i + (i & -i);
+		if(j <= n) {
+			f->tree[j] += f->tree[i];
+			f->count[j] += f->count[i];
+		}
+	}
+}
+
+void fenwickBuild(fenwick *f, int n, int (*value)(int)) {
+	fenwickFree(f);
+	int fill = FENWICK_BLOCK / 2;
+	f->numblocks = (n + fill - 1) / fill;
+	f->blocks = memAlloc(MEM_INDEX, sizeof(fenwickblock *) * (f->numblocks + 1));
+	for(int b = 0; b < f->numblocks; b++) {
+		fenwickblock *blk = memAlloc(MEM_INDEX, sizeof(fenwickblock));
+		blk->n = n - b * fill < fill ? n - b * fill : fill;
+		blk->sum = 0;
+		for(int k = 0; k < blk->n; k++) {
+			blk->val[k] = value(b * fill + k);
+			blk->sum += blk->val[k];
+		}
+		f->blocks[b] = blk;
+	}
+	f->n = n;
+	fenwickReindex(f);
+	f->valid = 1;
+}
+
+int fenwickLocate(fenwick *f, int i, int *off) {
+	int pos = 0, step = 1;
+	while(step * 2 <= f->numblocks) step *= 2;
+	for(; step > 0; step /= 2) {
+		if(pos + step <= f->numblocks && f->count[pos + step] <= i) {
+			pos += step;
+			i -= f->count[pos];
+		}
+	}
+	if(pos == f->numblocks && pos > 0) {
+		pos--;
+		i += f->blocks[pos]->n;
+	}
+	*off = i;
+	return pos;
+}
+
+int fenwickGet(fenwick *f, int i) {
+	int off;
+	if(i < 0 || i >= f->n) return 0;
+	return f->blocks[fenwickLocate(f, i, &off)]->val[off];
+}
+
+void fenwickSet(fenwick *f, int i, int v) {
+	int off;
+	if(i < 0 || i >= f->n) return;
+	int b = fenwickLocate(f, i, &off);
+	long long delta = v - f->blocks[b]->val[off];
+	if(delta == 0) return;
+	f->blocks[b]->val[off] = v;
+	f->blocks[b]->sum += delta;
+	for(b++; b <= f->numblocks; b += b & -b)
+		f->tree[b] += delta;
+}
+
+void fenwickInsert(fenwick *f, int i, int v) {
+	int off;
+	if(i < 0 || i > f->n) return;
+	if(f->numblocks == 0) {
+		f->blocks = memRealloc(MEM_INDEX, f->blocks, sizeof(fenwickblock *));
+		f->blocks[0] = memAlloc(MEM_INDEX, sizeof(fenwickblock));
+		f->blocks[0]->n = 0;
+		f->blocks[0]->sum = 0;
+		f->numblocks = 1;
+		fenwickReindex(f);
+	}
+	int b = fenwickLocate(f, i, &off);
+	fenwickblock *blk = f->blocks[b];
+	if(blk->n == FENWICK_BLOCK) {
+		fenwickblock *next = memAlloc(MEM_INDEX, sizeof(fenwickblock));
+		int half = FENWICK_BLOCK / 2;
+		next->n = FENWICK_BLOCK - half;
+		next->sum = 0;
+		memcpy(next->val, &blk->val[half], sizeof(int) * next->n);
+		for(int k = 0; k < next->n; k++)
+			next->sum += next->val[k];
+		blk->n = half;
+		blk->sum -= next->sum;
+		f->blocks = memRealloc(MEM_INDEX, f->blocks, sizeof(fenwickblock *) * (f->numblocks + 1));
+		memmove(&f->blocks[b + 2], &f->blocks[b + 1], sizeof(fenwickblock *) * (f->numblocks - b - 1));
+		f->blocks[b + 1] = next;
+		f->numblocks++;
+		fenwickReindex(f);
+		if(off >= half) {
+			b++;
+			off -= half;
+			blk = next;
+		}
+	}
+	memmove(&blk->val[off + 1], &blk->val[off], sizeof(int) * (blk->n - off));
+	blk->val[off] = v;
+	blk->n++;
+	blk->sum += v;
+	f->n++;
+	for(b++; b <= f->numblocks; b += b & -b) {
+		f->tree[b] += v;
+		f->count[b]++;
+	}
+}
+
+void fenwickDelete(fenwick *f, int i) {
+	int off;
+	if(i < 0 || i >= f->n) return;
+	int b = fenwickLocate(f, i, &off);
+	fenwickblock *blk = f->blocks[b];
+	int v = blk->val[off];
+	memmove(&blk->val[off], &blk->val[off + 1], sizeof(int) * (blk->n - off - 1));
+	blk->n--;
+	blk->sum -= v;
+	f->n--;
+	if(blk->n == 0) {
+		memFree(MEM_INDEX, blk);
+		memmove(&f->blocks[b], &f->blocks[b + 1], sizeof(fenwickblock *) * (f->numblocks - b - 1));
+		f->numblocks--;
+		fenwickReindex(f);
+		return;
+	}
+	for(b++; b <= f->numblocks; b += b & -b) {
+		f->tree[b] -= v;
+		f->count[b]--;
+	}
+}
+
+long long fenwickPrefix(fenwick *f, int i) {
+	int off;
+	long long sum = 0;
+	if(i > f->n) i = f->n;
+	if(i <= 0) return 0;
+	int b = fenwickLocate(f, i, &off);
+	for(int k = 0; k < off; k++)
+		sum += f->blocks[b]->val[k];
+	for(; b > 0; b -= b & -b)
+		sum += f->tree[b];
+	return sum;
+}
+
+int fenwickFind(fenwick *f, long long off) {
+	int pos = 0, i = 0, step = 1;
+	while(step * 2 <= f->numblocks) step *= 2;
+	for(; step > 0; step /= 2) {
+		if(pos + step <= f->numblocks && f->tree[pos + step] <= off) {
+			pos += step;
+			off -= f->tree[pos];
+			i += f->count[pos];
+		}
+	}
+	if(pos == f->numblocks) return i;
+	fenwickblock *blk = f->blocks[pos];
+	for(int k = 0; k < blk->n && blk->val[k] <= off; k++) {
+		off -= blk->val[k];
+		i++;
+	}
+	return i;
+}
+
+int editorRowBytes(int at) {
+	return editorRow(at)->size + 1;
+}
+
+fenwick *editorByteIndex() {
+	if(!E.bytes.valid)
+		fenwickBuild(&E.bytes, E.numrows, editorRowBytes);
+	return &E.bytes;
+}
+
+int editorWrapWidth() {
+	E.line_width = (int)log10(E.numrows ? E.numrows : 1) + 1;
+	int width = E.cols - E.line_width - 2;
+	return width < 1 ? 1 : width;
+}
+
+erow *editorRowMeasure(int at) {
+	erow *row = editorRow(at);
+	if(row->wrapw < 0) {
+		int len, width = 0, wide = 0;
+		const char *s = editorRowPeek(at, &len);
+		for(int j = 0, n, cp, w; j < len; j += n) {
+			if(s[j] == '\t') {
+				n = 1;
+				width += TAB_STOP - width % TAB_STOP;
+				continue;
+			}
+			n = utf8Decode(&s[j], len - j, &cp);
+			w = utf8Width(cp);
+			if(w > 1) wide = 1;
+			width += w;
+		}
+		row->wrapw = width;
+		row->wrapwide = wide;
+	}
+	return row;
+}
+
+int editorWrapWalk(int at, int stoprx, int stopseg, int *segrx) {
+	int len, seg = 0, col = 0, rx = 0, start = 0;
+	const char *s = editorRowPeek(at, &len);
+	for(int j = 0; j < len;) {
+		int cp = (unsigned char)s[j], n = 1, w = 1;
+		if(cp == '\t')
+			n = (rx + 1) % TAB_STOP == 0;
+		else if(cp >= 0x80) {
+			n = utf8Decode(&s[j], len - j, &cp);
+			w = utf8Width(cp);
+		}
+		if(col + w > E.wrapcols && col > 0) {
+			seg++;
+			col = 0;
+			start = rx;
+		}
+		if(seg == stopseg || (stoprx >= 0 && rx >= stoprx)) break;
+		col += w;
+		rx += w;
+		j += n;
+	}
+	*segrx = start;
+	return seg;
+}
+
+int editorRowVisual(int at) {
+	int segrx;
+	erow *row = editorRowMeasure(at);
+	if(row->wrapwide)
+		return editorWrapWalk(at, -1, -1, &segrx) + 1;
+	return row->wrapw > 0 ? (row->wrapw - 1) / E.wrapcols + 1 : 1;
+}
+
+fenwick *editorWrapIndex() {
+	int width = editorWrapWidth();
+	if(!E.wrap.valid || width != E.wrapcols) {
+		E.wrapcols = width;
+		fenwickBuild(&E.wrap, E.numrows, editorRowVisual);
+	}
+	return &E.wrap;
+}
+
+int editorWrapSeg(int at, int rx, int *segrx) {
+	erow *row = editorRowMeasure(at);
+	if(row->wrapwide)
+		return editorWrapWalk(at, rx, -1, segrx);
+	int seg = rx / E.wrapcols, last = row->wrapw > 0 ? (row->wrapw - 1) / E.wrapcols : 0;
+	if(seg > last) seg = last;
+	*segrx = seg * E.wrapcols;
+	return seg;
+}
+
+int editorWrapSegStart(int at, int seg) {
+	int segrx = seg * E.wrapcols;
+	if(editorRowMeasure(at)->wrapwide)
+		editorWrapWalk(at, -1, seg, &segrx);
+	return segrx;
+}
+
+long long editorWrapTop() {
+	return fenwickPrefix(editorWrapIndex(), E.rowoff) + E.wrapoff;
+}
+
+void editorWrapScroll(long long top) {
+	fenwick *w = editorWrapIndex();
+	long long total = fenwickPrefix(w, E.numrows);
+	if(top > total) top = total;
+	if(top < 0) top = 0;
+	E.rowoff = fenwickFind(w, top);
+	E.wrapoff = top - fenwickPrefix(w, E.rowoff);
+}
+
+void editorWrapCursor(long long v, int x) {
+	fenwick *w = editorWrapIndex();
+	if(v < 0) v = 0;
+	if(v >= fenwickPrefix(w, E.numrows)) {
+		E.cy = E.numrows;
+		E.cx = 0;
+		return;
+	}
+	E.cy = fenwickFind(w, v);
+	int segrx = editorWrapSegStart(E.cy, v - fenwickPrefix(w, E.cy));
+	E.cx = editorRowRxToCx(editorRowAt(E.cy), segrx + (x < 0 ? 0 : x));
+}
+
+int editorScreenPos(int at, int rx, int *y, int *x) {
+	if(!E.softwrap) {
+		*y = at - E.rowoff;
+		*x = rx - E.coloff;
+		return *y >= 0 && *y < E.rows;
+	}
+	int segrx = 0;
+	long long v = fenwickPrefix(editorWrapIndex(), at);
+	if(at < E.numrows) v += editorWrapSeg(at, rx, &segrx);
+	*y = v - editorWrapTop();
+	*x = rx - segrx;
+	if(*x >= E.wrapcols) *x = E.wrapcols - 1;
+	return *y >= 0 && *y < E.rows;
+}
+
+char *editorRowsToStr(long long *buflen) {
+	long long totlen = fenwickPrefix(editorByteIndex(), E.numrows);
+	*buflen = totlen;
+
+	char *buf = malloc(totlen);
+	char *p = buf;
+	for(int i = 0; i < E.numrows; i++) {
+		int len;
+		const char *chars = editorRowPeek(i, &len);
+		memcpy(p, chars, len);
+		p += len;
+		*p = '\n';
+		p++;
+	}
+
+	return buf;
+}
+
+void editorOpen(char *filename) {
+	initEditor();
+	free(E.filename);
+	E.filename = strdup(filename);
+	FILE *fp = fopen(filename, "r");
+	if(!fp) die("fopen");
+
+	struct stat st;
+	if(fstat(fileno(fp), &st) == 0) {
+		E.coldenabled = st.st_size >= COLD_MIN_BYTES;
+		if(sessionLoad(filename, fileno(fp), &st)) {
+			fclose(fp);
+			return;
+		}
+	}
+
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t linelen;
+	int coldfrom = COLD_HOT_ROWS, coldbytes = 0, plain = 1;
+	while((linelen = getline(&line, &linecap, fp)) != -1) {
+		ssize_t raw = linelen;
+		while(linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+			linelen--;
+		if(raw - linelen != 1 || line[linelen] != '\n') plain = 0;
+		editorInsertRow(E.numrows, line, linelen);
+		if(E.coldenabled && E.numrows > COLD_HOT_ROWS) {
+			coldbytes += linelen;
+			if(coldbytes >= COLD_BLOCK_BYTES) {
+				editorFreezeRows(coldfrom, E.numrows);
+				coldfrom = E.numrows;
+				coldbytes = 0;
+			}
+		}
+	}
+	free(line);
+	fclose(fp);
+	E.dirty = 0;
+	diffBaseline(snapshotCapture(), filename, plain);
+}
+
+void editorSave() {
+	if(E.filename == NULL) {
+		E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
+		if(E.filename == NULL) {
+			editorSetStatusMsg("Save aborted");
+			return;
+		}
+	}
+
+	if(E.save.snap)
+		E.save.pending = 1;
+	else
+		editorSaveStart(1);
+}
+
+void editorFindCallback(char *query, int key) {
+	static int last_match = -1;
+	static int direction = 1;
+
+	if(key == 10 || key == 27) {
+		last_match = -1;
+		direction = 1;
+		return;
+	} 
+	else if(key == KEY_RIGHT || key == KEY_DOWN) {
+		direction = 1;
+	}
+	else if(key == KEY_LEFT || key == KEY_UP) {
+		direction = -1;
+	}
+	else {
+		last_match = -1;
+		direction = 1;
+	}
+
+	if(last_match == -1) direction = 1;
+	int current = last_match;
+
+	for(int i = 0; i < E.numrows; i++) {
+		current += direction;
+		if(current == -1) current = E.numrows - 1;
+		else if(current == E.numrows) current = 0;
+
+		if(editorRow(current)->cold && !strchr(query, ' ')) {
+			int len;
+			const char *chars = editorRowPeek(current, &len);
+			if(!memmem(chars, len, query, strlen(query))) continue;
+		}
+		erow *row = editorRowAt(current);
+		char *match = strstr(row->render, query);
+		if(match) {
+			last_match = current;
+			E.cy = current;
+			E.cx = editorRowRxToCx(row, editorRenderByteToRx(row, match - row->render));
+			E.rowoff = E.numrows;
+			break;
+		}
+	}
+}
+
+void editorFind() {
+	int saved_cx = E.cx;
+	int saved_cy = E.cy;
+	int saved_coloff = E.coloff;
+	int saved_rowoff = E.rowoff;
+
+	char *query = editorPrompt("Search: %s (Use ESC/Arrow/Enter)", editorFindCallback);
+	if(query)
+		free(query);
+	else {
+		E.cx = saved_cx;
+		E.cy = saved_cy;
+		E.coloff = saved_coloff;
+		E.rowoff = saved_rowoff;
+	}
+}
+
+void editorGoto() {
+	char *query = editorPrompt("Goto: %s (line, or @byte offset)", NULL);
+	if(query == NULL) return;
+
+	char *end;
+	if(query[0] == '@') {
+		long long off = strtoll(&query[1], &end, 0);
+		fenwick *bytes = editorByteIndex();
+		if(*end != '\0' || off < 0 || off >= fenwickPrefix(bytes, E.numrows)) {
+			editorSetStatusMsg("Invalid offset: %s", &query[1]);
+		}
+		else {
+			E.cy = fenwickFind(bytes, off);
+			erow *row = editorRowAt(E.cy);
+			E.cx = off - fenwickPrefix(bytes, E.cy);
+			if(E.cx > row->size) E.cx = row->size;
+			E.cx = editorRowSnapCx(row, E.cx);
+		}
+	}
+	else {
+		long line = strtol(query, &end, 10);
+		if(*end != '\0' || line < 1 || line > E.numrows) {
+			editorSetStatusMsg("Invalid line: %s", query);
+		}
+		else {
+			E.cy = line - 1;
+			E.cx = 0;
+		}
+	}
+	free(query);
+}
+
+int editorIsWordChar(int c) {
+	return isalnum(c) || c == '_' || c >= 0x80;
+}
+
+int editorWordCmp(const char *a, int alen, const char *b, int blen) {
+	int r = memcmp(a, b, alen < blen ? alen : blen);
+	return r ? r : alen - blen;
+}
+
+int editorIndexCmp(const void *a, const void *b) {
+	wordtok *x = &E.index.tok[*(int *)a], *y = &E.index.tok[*(int *)b];
+	return editorWordCmp(x->word, x->len, y->word, y->len);
+}
+
+int editorIndexToken(const char *word, int len, int create) {
+	wordindex *x = &E.index;
+	if(create && x->numtok * 2 >= x->hashsize) {
+		int size = x->hashsize ? x->hashsize * 2 : 1024;
+		memFree(MEM_INDEX, x->hash);
+		x->hash = memAlloc(MEM_INDEX, sizeof(int) * size);
+		memset(x->hash, 0, sizeof(int) * size);
+		x->hashsize = size;
+		for(int i = 0; i < x->numtok; i++) {
+			unsigned int h = 2166136261u;
+			for(int j = 0; j < x->tok[i].len; j++)
+				h = (h ^ (unsigned char)x->tok[i].word[j]) * 16777619u;
+			while(x->hash[h & (size - 1)]) h++;
+			x->hash[h & (size - 1)] = i + 1;
+		}
+	}
+	if(x->hashsize == 0) return -1;
+
+	unsigned int h = 2166136261u;
+	for(int j = 0; j < len; j++)
+		h = (h ^ (unsigned char)word[j]) * 16777619u;
+	for(;; h++) {
+		int id = x->hash[h & (x->hashsize - 1)] - 1;
+		if(id == -1) break;
+		if(x->tok[id].len == len && memcmp(x->tok[id].word, word, len) == 0)
+			return id;
+	}
+	if(!create) return -1;
+
+	if(x->numtok % 1024 == 0)
+		x->tok = memRealloc(MEM_INDEX, x->tok, sizeof(wordtok) * (x->numtok + 1024));
+	wordtok *t = &x->tok[x->numtok];
+	t->word = memAlloc(MEM_INDEX, len + 1);
+	memcpy(t->word, word, len);
+	t->word[len] = '\0';
+	t->len = len;
+	t->count = 0;
+	t->rows = NULL;
+	t->numrows = 0;
+	t->caprows = 0;
+	t->epoch = x->numlog;
+	t->sorted = 1;
+	x->sealed = x->numlog;
+	x->hash[h & (x->hashsize - 1)] = x->numtok + 1;
+	return x->numtok++;
+}
+
+void editorIndexResolve(wordtok *t) {
+	wordindex *x = &E.index;
+	if(t->epoch == x->numlog) return;
+	int kept = 0;
+	for(int i = 0; i < t->numrows; i++) {
+		int r = t->rows[i];
+		for(int j = t->epoch; j < x->numlog && r != -1; j++) {
+			rowop *op = &x->log[j];
+			if(r < op->at) continue;
+			if(op->n > 0) r += op->n;
+			else r = r < op->at - op->n ? -1 : r + op->n;
+		}
+		if(r != -1) t->rows[kept++] = r;
+	}
+	t->numrows = kept;
+	t->epoch = x->numlog;
+	x->sealed = x->numlog;
+}
+
+void editorIndexRow(int at, int delta) {
+	int len;
+	const char *s = editorRowPeek(at, &len);
+	for(int i = 0; i < len;) {
+		if(!editorIsWordChar((unsigned char)s[i])) {
+			i++;
+			continue;
+		}
+		int start = i;
+		while(i < len && editorIsWordChar((unsigned char)s[i])) i++;
+		if(isdigit((unsigned char)s[start]) || i - start < 2 || i - start > INDEX_MAX_WORD) continue;
+		int id = editorIndexToken(&s[start], i - start, delta > 0);
+		if(id == -1) continue;
+		wordtok *t = &E.index.tok[id];
+		t->count += delta;
+		if(delta < 0) continue;
+		editorIndexResolve(t);
+		if(t->numrows && t->rows[t->numrows - 1] >= at) {
+			if(t->rows[t->numrows - 1] == at) continue;
+			t->sorted = 0;
+		}
+		if(t->numrows == t->caprows) {
+			t->caprows = t->caprows ? t->caprows * 2 : 4;
+			t->rows = memRealloc(MEM_INDEX, t->rows, sizeof(int) * t->caprows);
+		}
+		t->rows[t->numrows++] = at;
+	}
+}
+
+void editorIndexLog(int at, int n) {
+	wordindex *x = &E.index;
+	if(x->numtok == 0) return;
+	if(x->numlog > x->sealed) {
+		rowop *op = &x->log[x->numlog - 1];
+		if(n > 0 && op->n > 0 && at >= op->at && at <= op->at + op->n) {
+			op->n += n;
+			return;
+		}
+		if(n < 0 && op->n < 0 && (at == op->at || at == op->at - 1)) {
+			op->at = at;
+			op->n += n;
+			return;
+		}
+	}
+	if(x->numlog % 256 == 0)
+		x->log = memRealloc(MEM_INDEX, x->log, sizeof(rowop) * (x->numlog + 256));
+	x->log[x->numlog].at = at;
+	x->log[x->numlog].n = n;
+	x->numlog++;
+}
+
+void editorIndexRowChanged(int at) {
+	wordindex *x = &E.index;
+	if(!editorRow(at)->indexed) return;
+	editorIndexRow(at, -1);
+	editorRow(at)->indexed = 0;
+	x->pending++;
+	if(at < x->low) x->low = at;
+}
+
+void editorIndexRowInserted(int at) {
+	wordindex *x = &E.index;
+	editorIndexLog(at, 1);
+	x->pending++;
+	if(at < x->low) x->low = at;
+}
+
+void editorIndexRowDeleted(int at) {
+	wordindex *x = &E.index;
+	if(editorRow(at)->indexed)
+		editorIndexRow(at, -1);
+	else
+		x->pending--;
+	editorIndexLog(at, -1);
+	if(at < x->low) x->low--;
+}
+
+void editorIndexReset() {
+	wordindex *x = &E.index;
+	for(int i = 0; i < x->numtok; i++) {
+		memFree(MEM_INDEX, x->tok[i].word);
+		memFree(MEM_INDEX, x->tok[i].rows);
+	}
+	memFree(MEM_INDEX, x->tok);
+	memFree(MEM_INDEX, x->hash);
+	memFree(MEM_INDEX, x->sorted);
+	memFree(MEM_INDEX, x->log);
+	memset(x, 0, sizeof(wordindex));
+	for(int i = 0; i < E.numrows; i++)
+		editorRow(i)->indexed = 0;
+	x->pending = E.numrows;
+}
+
+int editorIndexTick(long long deadline) {
+	wordindex *x = &E.index;
+	if(E.pager || x->pending == 0) return 0;
+	int budget = 0;
+	while(x->pending > 0) {
+		if(x->low >= E.numrows) {
+			x->pending = 0;
+			break;
+		}
+		erow *row = editorRow(x->low);
+		if(!row->indexed) {
+			editorIndexRow(x->low, 1);
+			row->indexed = 1;
+			x->pending--;
+		}
+		x->low++;
+		if(++budget % 64 == 0 && editorNow() >= deadline) break;
+	}
+	if(x->pending == 0) x->low = E.numrows;
+	return 1;
+}
+
+void editorIndexSort() {
+	wordindex *x = &E.index;
+	if(x->numsorted == x->numtok) return;
+	x->sorted = memRealloc(MEM_INDEX, x->sorted, sizeof(int) * (x->numtok + 1));
+	if(x->numtok - x->numsorted > 64) {
+		for(int i = x->numsorted; i < x->numtok; i++)
+			x->sorted[i] = i;
+		qsort(x->sorted, x->numtok, sizeof(int), editorIndexCmp);
+	}
+	else {
+		for(int id = x->numsorted; id < x->numtok; id++) {
+			int pos = editorIndexLowerBound(x->tok[id].word, x->tok[id].len, id);
+			memmove(&x->sorted[pos + 1], &x->sorted[pos], sizeof(int) * (id - pos));
+			x->sorted[pos] = id;
+		}
+	}
+	x->numsorted = x->numtok;
+}
+
+int editorIndexLowerBound(const char *word, int len, int n) {
+	wordindex *x = &E.index;
+	int lo = 0, hi = n;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		wordtok *t = &x->tok[x->sorted[mid]];
+		if(editorWordCmp(t->word, t->len, word, len) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+int editorRowFindWord(int at, const char *word, int len) {
+	int rlen;
+	const char *s = editorRowPeek(at, &rlen);
+	for(int i = 0; i + len <= rlen; i++) {
+		if(memcmp(&s[i], word, len) == 0 && (i == 0 || !editorIsWordChar((unsigned char)s[i - 1])) &&
+				(i + len == rlen || !editorIsWordChar((unsigned char)s[i + len])))
+			return i;
+	}
+	return -1;
+}
+
+int editorIndexOccurrence(int id, int after, int *cx) {
+	wordtok *t = &E.index.tok[id];
+	editorIndexResolve(t);
+	if(!t->sorted) {
+		qsort(t->rows, t->numrows, sizeof(int), editorIntCmp);
+		int kept = 0;
+		for(int i = 0; i < t->numrows; i++)
+			if(kept == 0 || t->rows[kept - 1] != t->rows[i])
+				t->rows[kept++] = t->rows[i];
+		t->numrows = kept;
+		t->sorted = 1;
+	}
+	int lo = 0, hi = t->numrows;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		if(t->rows[mid] <= after) lo = mid + 1;
+		else hi = mid;
+	}
+	for(int i = 0; i < t->numrows; i++) {
+		int r = t->rows[(lo + i) % t->numrows];
+		if(r >= E.numrows) continue;
+		*cx = editorRowFindWord(r, t->word, t->len);
+		if(*cx != -1) return r;
+	}
+	return -1;
+}
+
+int editorIntCmp(const void *a, const void *b) {
+	return *(int *)a - *(int *)b;
+}
+
+void editorComplete() {
+	wordindex *x = &E.index;
+	if(E.cy >= E.numrows) return;
+	erow *row = editorRowAt(E.cy);
+
+	int cycle = 0;
+	if(x->numcand && E.cy == x->candcy && E.cx == x->candcx + x->candlen) {
+		wordtok *t = &x->tok[x->cand[x->curcand]];
+		cycle = x->candlen == t->len && memcmp(&row->chars[x->candcx], t->word, t->len) == 0;
+	}
+	if(cycle) {
+		while(E.cx > x->candcx + x->candplen)
+			editorDelChar(1);
+		x->curcand = (x->curcand + 1) % x->numcand;
+	}
+	else {
+		int start = E.cx;
+		while(start > 0 && editorIsWordChar((unsigned char)row->chars[start - 1])) start--;
+		if(start == E.cx || isdigit((unsigned char)row->chars[start])) {
+			editorSetStatusMsg("Nothing to complete");
+			return;
+		}
+		editorIndexSort();
+		const char *prefix = &row->chars[start];
+		int plen = E.cx - start;
+		x->numcand = 0;
+		for(int i = editorIndexLowerBound(prefix, plen, x->numsorted); i < x->numsorted; i++) {
+			wordtok *t = &x->tok[x->sorted[i]];
+			if(t->len < plen || memcmp(t->word, prefix, plen) != 0) break;
+			if(t->count <= 0 || t->len == plen) continue;
+			int j = x->numcand < INDEX_CANDIDATES ? x->numcand++ : INDEX_CANDIDATES;
+			while(j > 0 && x->tok[x->cand[j - 1]].count < t->count) {
+				if(j < INDEX_CANDIDATES) x->cand[j] = x->cand[j - 1];
+				j--;
+			}
+			if(j < INDEX_CANDIDATES) x->cand[j] = x->sorted[i];
+		}
+		if(x->numcand == 0) {
+			editorSetStatusMsg("No completions");
+			return;
+		}
+		x->curcand = 0;
+		x->candcx = start;
+		x->candcy = E.cy;
+		x->candplen = plen;
+	}
+
+	wordtok *t = &x->tok[x->cand[x->curcand]];
+	for(int j = x->candplen; j < t->len;) {
+		int cp;
+		j += utf8Decode(&t->word[j], t->len - j, &cp);
+		editorInsertChar(1, cp);
+	}
+	x->candlen = t->len;
+	editorSetStatusMsg("Completion %d/%d: %s", x->curcand + 1, x->numcand, t->word);
+}
+
+int editorFuzzyScore(const char *word, int len, const char *query) {
+	int score = 0, prev = -2, j = 0;
+	for(int i = 0; i < len && query[j]; i++) {
+		unsigned char c = word[i];
+		if(tolower(c) != tolower((unsigned char)query[j])) continue;
+		score += 1;
+		if(i == prev + 1) score += 4;
+		if(i == 0 || word[i - 1] == '_' || (isupper(c) && islower((unsigned char)word[i - 1]))) score += 6;
+		prev = i;
+		j++;
+	}
+	if(query[j]) return -1;
+	return score * 8 - len;
+}
+
+char jump_prompt[100] = "Jump to: %s";
+
+void editorJumpCallback(char *query, int key) {
+	static int best[INDEX_JUMP_MATCHES];
+	static int numbest = 0, sel = 0;
+	static int saved_cx, saved_cy;
+	wordindex *x = &E.index;
+
+	if(key == 10 || key == 27) {
+		numbest = 0;
+		strcpy(jump_prompt, "Jump to: %s");
+		return;
+	}
+	if(numbest == 0) {
+		saved_cx = E.cx;
+		saved_cy = E.cy;
+	}
+	if(key == KEY_DOWN || key == KEY_RIGHT) {
+		if(numbest) sel = (sel + 1) % numbest;
+	}
+	else if(key == KEY_UP || key == KEY_LEFT) {
+		if(numbest) sel = (sel + numbest - 1) % numbest;
+	}
+	else {
+		int score[INDEX_JUMP_MATCHES];
+		numbest = sel = 0;
+		for(int id = 0; id < x->numtok && query[0]; id++) {
+			wordtok *t = &x->tok[id];
+			if(t->count <= 0) continue;
+			int s = editorFuzzyScore(t->word, t->len, query);
+			if(s < 0) continue;
+			int j = numbest < INDEX_JUMP_MATCHES ? numbest++ : INDEX_JUMP_MATCHES;
+			while(j > 0 && (score[j - 1] < s || (score[j - 1] == s && x->tok[best[j - 1]].count < t->count))) {
+				if(j < INDEX_JUMP_MATCHES) {
+					best[j] = best[j - 1];
+					score[j] = score[j - 1];
 				}
-				word_len = 0;
+				j--;
+			}
+			if(j < INDEX_JUMP_MATCHES) {
+				best[j] = id;
+				score[j] = s;
 			}
 		}
 	}
+
+	if(numbest == 0) {
+		snprintf(jump_prompt, sizeof(jump_prompt), "Jump to: %%s (no match)");
+		if(query[0]) {
+			E.cx = saved_cx;
+			E.cy = saved_cy;
+		}
+		return;
+	}
+	wordtok *t = &x->tok[best[sel]];
+	snprintf(jump_prompt, sizeof(jump_prompt), "Jump to: %%s -> %.64s (%d/%d)", t->word, sel + 1, numbest);
+	int cx;
+	int r = editorIndexOccurrence(best[sel], saved_cy, &cx);
+	if(r != -1) {
+		E.cy = r;
+		E.cx = cx;
+		E.rowoff = E.numrows;
+	}
 }
 
-void editorRefreshScreen() {
-	editorScroll();
-	getWindowSize(&E.cols, &E.rows);
+void editorJump() {
+	int saved_cx = E.cx;
+	int saved_cy = E.cy;
+	int saved_coloff = E.coloff;
+	int saved_rowoff = E.rowoff;
 
-	abuf ab = ABUF_INIT;
+	char *query = editorPrompt(jump_prompt, editorJumpCallback);
+	if(query)
+		free(query);
+	else {
+		E.cx = saved_cx;
+		E.cy = saved_cy;
+		E.coloff = saved_coloff;
+		E.rowoff = saved_rowoff;
+	}
+}
 
-	curs_set(0);
-	move(0, 0);
-	editorDrawRows(&ab);
-	highlight_buffer(ab.b);
-	editorDrawStatusBar();
-	editorDrawMsgBar();
-	refresh();
-	move(E.cy - E.rowoff, E.rx - E.coloff + E.line_width + 1);
-	curs_set(2);
-	abFree(&ab);
+int bracketRowScan(int at, int *state) {
+	brackettree *b = &E.brackets;
+	int len, n = 0, st = *state;
+	const char *s = editorRowPeek(at, &len);
+	for(int i = 0; i < len; i++) {
+		char c = s[i];
+		if(st) {
+			if(c == '*' && i + 1 < len && s[i + 1] == '/') {
+				st = 0;
+				i++;
+			}
+			continue;
+		}
+		if(c == '/' && i + 1 < len && s[i + 1] == '/') break;
+		if(c == '/' && i + 1 < len && s[i + 1] == '*') {
+			st = 1;
+			i++;
+			continue;
+		}
+		if(c == '"' || c == '\'') {
+			for(i++; i < len && s[i] != c; i++)
+				if(s[i] == '\\') i++;
+			continue;
+		}
+		int open = (c == '(' || c == '[' || c == '{');
+		if(open || c == ')' || c == ']' || c == '}') {
+			if(n == b->evcap) {
+				b->evcap = b->evcap ? b->evcap * 2 : 64;
+				b->ev = memRealloc(MEM_INDEX, b->ev, sizeof(int) * b->evcap);
+			}
+			b->ev[n++] = i * 2 + open;
+		}
+	}
+	*state = st;
+	return n;
 }
 
-void editorSetStatusMsg(const char *fmt, ...) {
-	va_list ap;
-	va_start(ap, fmt);
-	vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
-	va_end(ap);
-	E.statusmsg_time = time(NULL);
+void bracketCombine(bracketsum *out, bracketsum *l, bracketsum *r) {
+	bracketsum t;
+	for(int s = 0; s < 2; s++) {
+		int m = l->exit[s];
+		t.delta[s] = l->delta[s] + r->delta[m];
+		t.min[s] = l->min[s] < l->delta[s] + r->min[m] ? l->min[s] : l->delta[s] + r->min[m];
+		t.minclose[s] = l->minclose[s] < l->delta[s] + r->minclose[m] ? l->minclose[s] : l->delta[s] + r->minclose[m];
+		t.exit[s] = r->exit[m];
+	}
+	t.rows = l->rows + r->rows;
+	*out = t;
 }
 
-void editorRowInsertChar(erow *row, int at, int c) {
-	if(at < 0 || at > row->size) at = row->size;
-	row->chars = realloc(row->chars, row->size + 2);
-	memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-	row->size++;
-	row->chars[at] = c;
-	editorUpdateRow(row);
-	E.dirty = 1;
+void bracketLeaf(int leaf, int start) {
+	brackettree *b = &E.brackets;
+	bracketsum *sum = &b->node[b->size + leaf];
+	int st[2] = {0, 1}, depth[2] = {0, 0}, min[2] = {0, 0};
+	int minclose[2] = {BRACKET_NONE, BRACKET_NONE};
+	for(int r = start; r < start + sum->rows; r++) {
+		int n = 0, from = st[0], exit = 0;
+		for(int s = 0; s < 2; s++) {
+			if(s == 0 || st[1] != from) {
+				from = st[s];
+				n = bracketRowScan(r, &st[s]);
+				exit = st[s];
+			}
+			else {
+				st[s] = exit;
+			}
+			for(int i = 0; i < n; i++) {
+				if(b->ev[i] & 1) {
+					depth[s]++;
+					continue;
+				}
+				if(--depth[s] < min[s]) min[s] = depth[s];
+				if(depth[s] < minclose[s]) minclose[s] = depth[s];
+			}
+		}
+	}
+	for(int s = 0; s < 2; s++) {
+		sum->delta[s] = depth[s];
+		sum->min[s] = min[s];
+		sum->minclose[s] = minclose[s];
+		sum->exit[s] = st[s];
+	}
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len) {
-	row->chars = realloc(row->chars, row->size + len + 1);
-	memcpy(&row->chars[row->size], s, len);
-	row->size += len;
-	row->chars[row->size] = '\0';
-	editorUpdateRow(row);
-	E.dirty = 1;
+void bracketPull(int leaf) {
+	brackettree *b = &E.brackets;
+	for(int i = (b->size + leaf) / 2; i >= 1; i /= 2)
+		bracketCombine(&b->node[i], &b->node[2 * i], &b->node[2 * i + 1]);
 }
 
-void editorInsertChar(int isundoredo, int c) {
-	if(E.cy == E.numrows)
-		editorInsertRow(E.numrows, "", 0);
-	editorRowInsertChar(&E.row[E.cy], E.cx, c);
-	E.cx++;
-	if(isundoredo)
-		undo_push(&E.u, &E.r, c, 0, 0);
+void bracketBuildNodes(int numleaves) {
+	brackettree *b = &E.brackets;
+	int size = 1;
+	while(size < numleaves + 1) size *= 2;
+	int kept = b->numleaves < numleaves ? b->numleaves : numleaves;
+	if(size != b->size) {
+		bracketsum *node = memAlloc(MEM_INDEX, sizeof(bracketsum) * 2 * size);
+		if(b->node) memcpy(&node[size], &b->node[b->size], sizeof(bracketsum) * kept);
+		memFree(MEM_INDEX, b->node);
+		b->node = node;
+		b->size = size;
+	}
+	for(int i = kept; i < size; i++) {
+		bracketsum *sum = &b->node[size + i];
+		sum->delta[0] = sum->delta[1] = 0;
+		sum->min[0] = sum->min[1] = 0;
+		sum->minclose[0] = sum->minclose[1] = BRACKET_NONE;
+		sum->exit[0] = 0;
+		sum->exit[1] = 1;
+		sum->rows = 0;
+	}
+	b->numleaves = numleaves;
+	for(int i = size - 1; i >= 1; i--)
+		bracketCombine(&b->node[i], &b->node[2 * i], &b->node[2 * i + 1]);
 }
 
-void editorInsertNewline(int isundoredo) {
-	if (E.cx == 0) {
-		editorInsertRow(E.cy, "", 0);
+int bracketBuild(long long deadline) {
+	brackettree *b = &E.brackets;
+	if(E.pager || b->valid) return 0;
+	int numleaves = (E.numrows + BRACKET_LEAF_ROWS - 1) / BRACKET_LEAF_ROWS;
+	if(!b->building) {
+		b->numleaves = 0;
+		bracketBuildNodes(numleaves);
+		b->building = 1;
+		b->buildleaf = 0;
+	}
+	while(b->buildleaf < numleaves) {
+		int i = b->buildleaf++;
+		int start = i * BRACKET_LEAF_ROWS;
+		b->node[b->size + i].rows = E.numrows - start < BRACKET_LEAF_ROWS ? E.numrows - start : BRACKET_LEAF_ROWS;
+		bracketLeaf(i, start);
+		if(b->buildleaf % 16 == 0 && editorNow() >= deadline) return 1;
+	}
+	bracketBuildNodes(numleaves);
+	b->building = 0;
+	b->valid = 1;
+	b->version++;
+	return 1;
+}
+
+int bracketLeafOf(int row, int *start) {
+	brackettree *b = &E.brackets;
+	int i = 1;
+	*start = 0;
+	while(i < b->size) {
+		if(row < *start + b->node[2 * i].rows) {
+			i = 2 * i;
+		}
+		else {
+			*start += b->node[2 * i].rows;
+			i = 2 * i + 1;
+		}
+	}
+	return i - b->size;
+}
+
+void bracketRowInserted(int at) {
+	brackettree *b = &E.brackets;
+	if(!b->valid) {
+		b->building = 0;
+		return;
+	}
+	if(b->numleaves == 0) bracketBuildNodes(1);
+	int start, leaf;
+	if(at >= b->node[1].rows) {
+		leaf = b->numleaves - 1;
+		start = b->node[1].rows - b->node[b->size + leaf].rows;
 	}
 	else {
-		erow *row = &E.row[E.cy];
-		editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-		row = &E.row[E.cy];
-		row->size = E.cx;
-		row->chars[row->size] = '\0';
-		editorUpdateRow(row);
+		leaf = bracketLeafOf(at, &start);
 	}
-	if(isundoredo)
-		undo_push(&E.u, &E.r, '\n', 0, 0);
-	E.cy++;
-	E.cx = 0;
+	b->version++;
+	bracketsum *sum = &b->node[b->size + leaf];
+	if(++sum->rows <= 2 * BRACKET_LEAF_ROWS) {
+		bracketLeaf(leaf, start);
+		bracketPull(leaf);
+		return;
+	}
+	int n = b->numleaves;
+	bracketBuildNodes(n + 1);
+	memmove(&b->node[b->size + leaf + 1], &b->node[b->size + leaf], sizeof(bracketsum) * (n - leaf));
+	int rows = b->node[b->size + leaf].rows;
+	b->node[b->size + leaf].rows = rows / 2;
+	b->node[b->size + leaf + 1].rows = rows - rows / 2;
+	bracketLeaf(leaf, start);
+	bracketLeaf(leaf + 1, start + rows / 2);
+	bracketBuildNodes(n + 1);
+}
+
+void bracketRowDeleted(int at) {
+	brackettree *b = &E.brackets;
+	if(!b->valid) {
+		b->building = 0;
+		return;
+	}
+	int start;
+	int leaf = bracketLeafOf(at, &start);
+	b->version++;
+	bracketsum *sum = &b->node[b->size + leaf];
+	if(--sum->rows > 0) {
+		bracketLeaf(leaf, start);
+		bracketPull(leaf);
+		return;
+	}
+	int n = b->numleaves;
+	memmove(&b->node[b->size + leaf], &b->node[b->size + leaf + 1], sizeof(bracketsum) * (n - leaf - 1));
+	bracketBuildNodes(n - 1);
+}
+
+void bracketRowChanged(int at) {
+	brackettree *b = &E.brackets;
+	if(!b->valid) {
+		int leaf = at / BRACKET_LEAF_ROWS;
+		if(b->building && leaf < b->buildleaf)
+			bracketLeaf(leaf, leaf * BRACKET_LEAF_ROWS);
+		return;
+	}
+	if(at >= b->node[1].rows) return;
+	int start;
+	int leaf = bracketLeafOf(at, &start);
+	b->version++;
+	bracketLeaf(leaf, start);
+	bracketPull(leaf);
+}
+
+void bracketPrefix(int row, int *state, int *depth) {
+	brackettree *b = &E.brackets;
+	int i = 1, start = 0, st = 0, d = 0;
+	while(i < b->size) {
+		bracketsum *l = &b->node[2 * i];
+		if(row < start + l->rows) {
+			i = 2 * i;
+		}
+		else {
+			d += l->delta[st];
+			st = l->exit[st];
+			start += l->rows;
+			i = 2 * i + 1;
+		}
+	}
+	for(int r = start; r < row; r++) {
+		int n = bracketRowScan(r, &st);
+		for(int j = 0; j < n; j++)
+			d += (b->ev[j] & 1) ? 1 : -1;
+	}
+	*state = st;
+	*depth = d;
+}
+
+int bracketFindBack(int i, int l, int r, int k, int st, int d, int *rows, int target) {
+	brackettree *b = &E.brackets;
+	if(l >= k) return -1;
+	bracketsum *n = &b->node[i];
+	if(d + n->min[st] > target) return -1;
+	if(i >= b->size) return l;
+	bracketsum *left = &b->node[2 * i];
+	int m = (l + r) / 2;
+	int res = bracketFindBack(2 * i + 1, m, r, k, left->exit[st], d + left->delta[st], rows, target);
+	if(res != -1) {
+		*rows += left->rows;
+		return res;
+	}
+	return bracketFindBack(2 * i, l, m, k, st, d, rows, target);
+}
+
+int bracketFindForward(int i, int l, int r, int k, int *st, int *d, int *rows, int target) {
+	brackettree *b = &E.brackets;
+	bracketsum *n = &b->node[i];
+	if(l >= b->numleaves) return -1;
+	if(r <= k + 1 || *d + n->minclose[*st] > target) {
+		*d += n->delta[*st];
+		*st = n->exit[*st];
+		*rows += n->rows;
+		return -1;
+	}
+	if(i >= b->size) return l;
+	int m = (l + r) / 2;
+	int res = bracketFindForward(2 * i, l, m, k, st, d, rows, target);
+	if(res != -1) return res;
+	return bracketFindForward(2 * i + 1, m, r, k, st, d, rows, target);
+}
+
+int bracketScanBack(int from, int to, int col, int st, int d, int target, int *orow, int *ocol) {
+	brackettree *b = &E.brackets;
+	int found = 0, pending = 0;
+	for(int r = from; r <= to; r++) {
+		if(d <= target) pending = 1;
+		int n = bracketRowScan(r, &st);
+		for(int j = 0; j < n; j++) {
+			int pos = b->ev[j] >> 1;
+			if(r == to && col != -1 && pos >= col) break;
+			if((b->ev[j] & 1) && pending) {
+				*orow = r;
+				*ocol = pos;
+				found = 1;
+				pending = 0;
+			}
+			d += (b->ev[j] & 1) ? 1 : -1;
+			if(d <= target) pending = 1;
+		}
+	}
+	return found && !pending;
+}
+
+int bracketBackward(int row, int col, int target, int *orow, int *ocol) {
+	brackettree *b = &E.brackets;
+	int start, st, d;
+	int leaf = bracketLeafOf(row, &start);
+	bracketPrefix(start, &st, &d);
+	if(bracketScanBack(start, row, col, st, d, target, orow, ocol)) return 1;
+
+	int rows = 0;
+	int j = bracketFindBack(1, 0, b->size, leaf, 0, 0, &rows, target);
+	if(j == -1) return 0;
+	bracketPrefix(rows, &st, &d);
+	return bracketScanBack(rows, rows + b->node[b->size + j].rows - 1, -1, st, d, target, orow, ocol);
+}
+
+int bracketScanForward(int from, int to, int row, int col, int st, int d, int target, int *orow, int *ocol) {
+	brackettree *b = &E.brackets;
+	for(int r = from; r <= to; r++) {
+		int n = bracketRowScan(r, &st);
+		for(int j = 0; j < n; j++) {
+			int pos = b->ev[j] >> 1;
+			d += (b->ev[j] & 1) ? 1 : -1;
+			if(r < row || (r == row && pos < col)) continue;
+			if(!(b->ev[j] & 1) && d <= target) {
+				*orow = r;
+				*ocol = pos;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int bracketForward(int row, int col, int target, int *orow, int *ocol) {
+	brackettree *b = &E.brackets;
+	int start, st, d;
+	int leaf = bracketLeafOf(row, &start);
+	bracketPrefix(start, &st, &d);
+	if(bracketScanForward(start, start + b->node[b->size + leaf].rows - 1, row, col, st, d, target, orow, ocol))
+		return 1;
+
+	int rows = 0;
+	st = d = 0;
+	int j = bracketFindForward(1, 0, b->size, leaf, &st, &d, &rows, target);
+	if(j == -1) return 0;
+	return bracketScanForward(rows, rows + b->node[b->size + j].rows - 1, rows, 0, st, d, target, orow, ocol);
+}
+
+int bracketDepthAt(int row, int col) {
+	brackettree *b = &E.brackets;
+	int st, d;
+	bracketPrefix(row, &st, &d);
+	if(row >= E.numrows) return d;
+	int n = bracketRowScan(row, &st);
+	for(int j = 0; j < n && (b->ev[j] >> 1) < col; j++)
+		d += (b->ev[j] & 1) ? 1 : -1;
+	return d;
+}
+
+brackettree *editorBrackets() {
+	brackettree *b = &E.brackets;
+	if(!b->valid) bracketBuild(LLONG_MAX);
+	if(b->cachecx == E.cx && b->cachecy == E.cy && b->cacheversion == b->version)
+		return b;
+	b->cachecx = E.cx;
+	b->cachecy = E.cy;
+	b->cacheversion = b->version;
+	b->numpath = 0;
+	b->closerow = -1;
+
+	int r = E.cy, c = E.cx;
+	b->depth = bracketDepthAt(r, c);
+	int target = b->depth - 1;
+	while(b->numpath < BRACKET_PATH && bracketBackward(r, c, target, &r, &c)) {
+		int len;
+		b->path[b->numpath][0] = r;
+		b->path[b->numpath][1] = c;
+		b->pathch[b->numpath] = editorRowPeek(r, &len)[c];
+		b->numpath++;
+		target--;
+	}
+	if(b->numpath)
+		bracketForward(b->path[0][0], b->path[0][1] + 1, b->depth - 1, &b->closerow, &b->closecol);
+	return b;
+}
+
+void editorMatchBracket() {
+	if(E.cy >= E.numrows) return;
+	brackettree *b = editorBrackets();
+	int st, d;
+	bracketPrefix(E.cy, &st, &d);
+	int n = bracketRowScan(E.cy, &st);
+	int ev = -1;
+	for(int j = 0; j < n; j++) {
+		int pos = b->ev[j] >> 1;
+		if(pos == E.cx || (pos == E.cx - 1 && ev == -1)) ev = b->ev[j];
+		if(pos >= E.cx) break;
+	}
+	if(ev == -1) {
+		editorSetStatusMsg("No bracket at cursor");
+		return;
+	}
+	int pos = ev >> 1, depth = bracketDepthAt(E.cy, pos);
+	int row, col, found;
+	if(ev & 1)
+		found = bracketForward(E.cy, pos + 1, depth, &row, &col);
+	else
+		found = bracketBackward(E.cy, pos, depth - 1, &row, &col);
+	if(!found) {
+		editorSetStatusMsg("Unmatched bracket");
+		return;
+	}
+	E.cy = row;
+	E.cx = col;
+}
+
+void editorHlCells(abuf *ab, int start, int end, int col, int n, unsigned char color) {
+	int x = 0;
+	for(int i = start; i < end && x < col + n;) {
+		int m = 1, cp = (unsigned char)ab->b[i], w = 1;
+		if(cp >= 0x80) {
+			m = utf8Decode(&ab->b[i], end - i, &cp);
+			w = utf8Width(cp);
+		}
+		if(x >= col)
+			memset(&ab->c[i], color, m);
+		x += w;
+		i += m;
+	}
+}
+
+void editorDrawBlock(abuf *ab) {
+	if(E.pager || E.numrows == 0 || !E.brackets.valid) return;
+	brackettree *b = editorBrackets();
+	if(b->numpath == 0) return;
+	int start[E.rows + 1];
+	start[0] = 0;
+	for(int y = 1; y <= E.rows; y++) {
+		const char *nl = memchr(&ab->b[start[y - 1]], '\n', ab->len - start[y - 1]);
+		start[y] = nl ? nl - ab->b + 1 : ab->len;
+	}
+	int top = b->path[0][0], bottom = b->closerow == -1 ? E.numrows - 1 : b->closerow;
+	long long vtop = E.softwrap ? editorWrapTop() : 0;
+	for(int y = 0; y < E.rows; y++) {
+		int filerow = E.softwrap ? fenwickFind(&E.wrap, vtop + y) : y + E.rowoff;
+		if(filerow >= top && filerow <= bottom && filerow < E.numrows)
+			editorHlCells(ab, start[y], start[y + 1] - 1, 0, E.line_width, filerow == E.mark ? 3 | HL_BOLD | HL_REVERSE : 3 | HL_BOLD);
+	}
+	int ends[2][2] = {{b->path[0][0], b->path[0][1]}, {b->closerow, b->closecol}};
+	for(int i = 0; i < 2; i++) {
+		int y = ends[i][0] - E.rowoff, x;
+		if(ends[i][0] == -1 || y < 0 || y >= E.rows) continue;
+		if(!editorScreenPos(ends[i][0], editorRowCxToRx(editorRowAt(ends[i][0]), ends[i][1]), &y, &x)) continue;
+		if(x >= 0 && x < E.cols - E.line_width - 1)
+			editorHlCells(ab, start[y], start[y + 1] - 1, x + E.line_width + 1, 1, 5 | HL_REVERSE);
+	}
+}
+
+unsigned int diffHash(const char *s, int len) {
+	unsigned int h = 2166136261u;
+	for(int i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	return h;
+}
+
+unsigned int diffRowHash(int at) {
+	erow *row = editorRow(at);
+	if(!row->hashed) {
+		int len;
+		const char *s = editorRowPeek(at, &len);
+		row->hash = diffHash(s, len);
+		row->hashed = 1;
+	}
+	return row->hash;
+}
+
+void diffTouch(int lo, int hi) {
+	diffstate *d = &E.diff;
+	if(d->lo > d->hi) {
+		d->lo = lo;
+		d->hi = hi;
+		return;
+	}
+	if(lo < d->lo) d->lo = lo;
+	if(hi > d->hi) d->hi = hi;
+}
+
+void diffRowChanged(int at) {
+	editorRow(at)->hashed = 0;
+	diffTouch(at, at);
+}
+
+void diffRowInserted(int at) {
+	diffstate *d = &E.diff;
+	if(d->lo <= d->hi) {
+		if(d->lo >= at) d->lo++;
+		if(d->hi >= at) d->hi++;
+	}
+	diffTouch(at, at);
+}
+
+void diffRowDeleted(int at) {
+	diffstate *d = &E.diff;
+	if(d->lo <= d->hi) {
+		if(d->lo > at) d->lo--;
+		if(d->hi >= at) d->hi--;
+	}
+	diffTouch(at, at);
+}
+
+void diffMark(int at, int mark, int disk) {
+	erow *row = editorRow(at);
+	row->diff = mark;
+	row->disk = disk;
+}
+
+void diffBaseline(snapshot *base, const char *path, int plain) {
+	diffstate *d = &E.diff;
+	if(d->base) snapshotRelease(d->base);
+	d->base = base;
+	d->hashed = 0;
+	d->plain = plain && stat(path, &d->st) == 0;
 }
 
-void editorRowDelChar(erow *row, int at) {
-	if(at < 0 || at >= row->size) return;
-	memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-	row->size--;
-	editorUpdateRow(row);
-	E.dirty = 1;
+void diffGreedy(const unsigned int *a, int n, const unsigned int *b, int m, char *da, char *db) {
+	int max = n + m, d, found = 0;
+	int *v = malloc(sizeof(int) * (2 * max + 3));
+	int **trace = malloc(sizeof(int *) * (max + 1));
+	v[max + 2] = 0;
+	for(d = 0; d <= max; d++) {
+		for(int k = -d; k <= d && !found; k += 2) {
+			int x;
+			if(k == -d || (k != d && v[max + k] < v[max + k + 2]))
+				x = v[max + k + 2];
+			else
+				x = v[max + k] + 1;
+			int y = x - k;
+			while(x < n && y < m && a[x] == b[y]) {
+				x++;
+				y++;
+			}
+			v[max + k + 1] = x;
+			found = x >= n && y >= m;
+		}
+		trace[d] = malloc(sizeof(int) * (2 * d + 1));
+		memcpy(trace[d], &v[max + 1 - d], sizeof(int) * (2 * d + 1));
+		if(found) break;
+	}
+
+	int x = n, y = m;
+	for(int i = d; i > 0; i--) {
+		int *pv = &trace[i - 1][i - 1];
+		int k = x - y, pk;
+		if(k == -i || (k != i && pv[k - 1] < pv[k + 1]))
+			pk = k + 1;
+		else
+			pk = k - 1;
+		int px = pv[pk], py = px - pk;
+		if(pk == k + 1)
+			db[py] = 1;
+		else
+			da[px] = 1;
+		x = px;
+		y = py;
+	}
+	for(int i = 0; i <= d; i++)
+		free(trace[i]);
+	free(trace);
+	free(v);
 }
 
-void editorDelChar(int isundoredo) {
-	if(E.cx == 0 && E.cy == 0) return;
-	if(E.cy == E.numrows) {
-		if(E.cy == 0) return;
-		E.cx = E.row[E.cy - 1].size;
-		E.cy--;
+void diffBisect(const unsigned int *a, int n, const unsigned int *b, int m, char *da, char *db) {
+	int maxd = (n + m + 1) / 2, off = maxd, len = 2 * maxd;
+	int *v1 = malloc(sizeof(int) * 2 * len), *v2 = &v1[len];
+	for(int i = 0; i < 2 * len; i++)
+		v1[i] = -1;
+	v1[off + 1] = v2[off + 1] = 0;
+	int delta = n - m, front = delta & 1;
+	int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+	int sx = -1, sy = -1;
+	for(int d = 0; d < maxd && sx == -1 && E.diff.work > 0; d++) {
+		for(int k1 = -d + k1start; k1 <= d - k1end && sx == -1; k1 += 2) {
+			int k1off = off + k1, x1;
+			if(k1 == -d || (k1 != d && v1[k1off - 1] < v1[k1off + 1]))
+				x1 = v1[k1off + 1];
+			else
+				x1 = v1[k1off - 1] + 1;
+			int y1 = x1 - k1;
+			while(x1 < n && y1 < m && a[x1] == b[y1]) {
+				x1++;
+				y1++;
+				E.diff.work--;
+			}
+			v1[k1off] = x1;
+			E.diff.work--;
+			if(x1 > n) {
+				k1end += 2;
+			}
+			else if(y1 > m) {
+				k1start += 2;
+			}
+			else if(front) {
+				int k2off = off + delta - k1;
+				if(k2off >= 0 && k2off < len && v2[k2off] != -1 && x1 >= n - v2[k2off]) {
+					sx = x1;
+					sy = y1;
+				}
+			}
+		}
+		for(int k2 = -d + k2start; k2 <= d - k2end && sx == -1; k2 += 2) {
+			int k2off = off + k2, x2;
+			if(k2 == -d || (k2 != d && v2[k2off - 1] < v2[k2off + 1]))
+				x2 = v2[k2off + 1];
+			else
+				x2 = v2[k2off - 1] + 1;
+			int y2 = x2 - k2;
+			while(x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) {
+				x2++;
+				y2++;
+				E.diff.work--;
+			}
+			v2[k2off] = x2;
+			E.diff.work--;
+			if(x2 > n) {
+				k2end += 2;
+			}
+			else if(y2 > m) {
+				k2start += 2;
+			}
+			else if(!front) {
+				int k1off = off + delta - k2;
+				if(k1off >= 0 && k1off < len && v1[k1off] != -1 && v1[k1off] >= n - x2) {
+					sx = v1[k1off];
+					sy = sx - (k1off - off);
+				}
+			}
+		}
+	}
+	free(v1);
+	if(sx == -1) {
+		memset(da, 1, n);
+		memset(db, 1, m);
 		return;
 	}
+	diffCompare(a, sx, b, sy, da, db);
+	diffCompare(&a[sx], n - sx, &b[sy], m - sy, &da[sx], &db[sy]);
+}
 
-	erow *row = &E.row[E.cy];
-	if(E.cx > 0) {
-		if(isundoredo)
-			undo_push(&E.u, &E.r, E.row[E.cy].chars[E.cx - 1], 1, 0);
-		editorRowDelChar(row, E.cx - 1);
-		E.cx--;
+void diffCompare(const unsigned int *a, int n, const unsigned int *b, int m, char *da, char *db) {
+	int p = 0, s = 0;
+	while(p < n && p < m && a[p] == b[p]) p++;
+	while(s < n - p && s < m - p && a[n - s - 1] == b[m - s - 1]) s++;
+	E.diff.work -= p + s;
+	a += p;
+	b += p;
+	da += p;
+	db += p;
+	n -= p + s;
+	m -= p + s;
+	if(n == 0 || m == 0 || E.diff.work <= 0) {
+		memset(da, 1, n);
+		memset(db, 1, m);
+	}
+	else if(n + m <= DIFF_GREEDY_ROWS) {
+		diffGreedy(a, n, b, m, da, db);
 	}
 	else {
-	    if(isundoredo)
-    		undo_push(&E.u, &E.r, '\n', 1, 0);
-	    E.cx = E.row[E.cy - 1].size;
-	    editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
-	    editorDelRow(E.cy);
-	    E.cy--;
+		diffBisect(a, n, b, m, da, db);
 	}
 }
 
-char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
-	size_t bufsize = 128;
-	char *buf = malloc(bufsize);
-	size_t buflen = 0;
-	buf[0] = '\0';
+void diffUpdate() {
+	diffstate *d = &E.diff;
+	int r0 = d->lo < 0 ? 0 : d->lo, r1 = d->hi + 1 > E.numrows ? E.numrows : d->hi + 1;
+	d->lo = 1;
+	d->hi = 0;
+	if(r0 > r1) r0 = r1;
+	while(r0 > 0 && editorRow(r0 - 1)->disk < 0) r0--;
+	while(r1 < E.numrows && editorRow(r1)->disk < 0) r1++;
+	int d0 = r0 > 0 ? editorRow(r0 - 1)->disk + 1 : 0;
+	int d1 = r1 < E.numrows ? editorRow(r1)->disk : d->numdisk;
+	int n = d1 - d0, m = r1 - r0;
+
+	unsigned int *b = malloc(sizeof(unsigned int) * (m + 1));
+	for(int j = 0; j < m; j++)
+		b[j] = diffRowHash(r0 + j);
+	char *da = calloc(n + 1, 1), *db = calloc(m + 1, 1);
+	d->work = DIFF_MAX_WORK;
+	diffCompare(&d->disk[d0], n, b, m, da, db);
+
+	int i = 0, j = 0;
 	while(1) {
-		editorSetStatusMsg(prompt, buf);
-		editorRefreshScreen();
-		int c = getch();
-		if(c == KEY_DC || c == ctrl('h') || c == KEY_BACKSPACE) {
-			if(buflen != 0) buf[--buflen] = '\0';
+		int dels = 0, start = j;
+		while(i < n && da[i]) {
+			i++;
+			dels++;
 		}
-		else if(c == 27) {
-			editorSetStatusMsg("");
-			if(callback) callback(buf, c);
-			free(buf);
-			return NULL;
+		while(j < m && db[j]) {
+			diffMark(r0 + j, j - start < dels ? DIFF_CHANGE : DIFF_ADD, -1);
+			j++;
 		}
-		else if(c == 10) {
-			if (buflen != 0) {
-			  editorSetStatusMsg("");
-			  if(callback) callback(buf, c);
-			  return buf;
-			}
+		int del = dels > 0 && j == start;
+		if(i >= n || j >= m) {
+			if(r1 < E.numrows)
+				diffMark(r1, del ? DIFF_DEL : DIFF_SAME, d1);
+			else
+				d->taildel = del;
+			break;
 		}
-		else if(!iscntrl(c) && c < 128) {
-			if(buflen == bufsize - 1) {
-				bufsize *= 2;
-				buf = realloc(buf, bufsize);
-			}
-			buf[buflen++] = c;
-			buf[buflen] = '\0';
+		diffMark(r0 + j, del ? DIFF_DEL : DIFF_SAME, d0 + i);
+		i++;
+		j++;
+	}
+	free(da);
+	free(db);
+	free(b);
+}
+
+int diffTick(long long deadline) {
+	diffstate *d = &E.diff;
+	if(E.pager) return 0;
+	if(d->base) {
+		snapshot *s = d->base;
+		if(d->hashed == 0)
+			d->disk = memRealloc(MEM_INDEX, d->disk, sizeof(unsigned int) * (s->numrows + 1));
+		while(d->hashed < s->numrows) {
+			erow *row = rowtableAt(&s->row, d->hashed);
+			unsigned int h = row->hash;
+			if(!row->hashed)
+				h = diffHash(row->cold ? &coldBlockData(row->cold)[row->coldoff] : row->chars, row->size);
+			d->disk[d->hashed++] = h;
+			if(d->hashed % 256 == 0 && editorNow() >= deadline) return 1;
 		}
-		if(callback) callback(buf, c);
+		d->numdisk = s->numrows;
+		snapshotRelease(s);
+		d->base = NULL;
+		d->taildel = 0;
+		d->lo = 0;
+		d->hi = E.numrows;
+		return 1;
 	}
+	if(!d->enabled || d->lo > d->hi) return 0;
+	diffUpdate();
+	return 1;
 }
 
-int isPrintable(int c) {
-	return (c == '\t' || (c >= 32 && c <= 126));
+void diffToggle() {
+	E.diff.enabled = !E.diff.enabled;
+	editorSetStatusMsg("Diff gutter %s", E.diff.enabled ? "on" : "off");
 }
 
-void editorMoveCursor(int c) {
-	erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-	switch(c) {
-		case KEY_LEFT:
-			if(E.cx != 0) E.cx--;
-			else if(E.cy > 0) {
-				E.cy--;
-				E.cx = E.row[E.cy].size;
-			}
-			break;
-		case KEY_RIGHT:
-			if(row && E.cx < row->size) E.cx++;
-			else if(row && E.cx == row->size) {
-				E.cy++;
-				E.cx = 0;
-			}
-			break;
-		case KEY_UP:
-			if(E.cy != 0) E.cy--;
-			break;
-		case KEY_DOWN:
-			if(E.cy < E.numrows) E.cy++;
-			break;
-		case KEY_HOME:
-			E.cx = 0;
-			break;
-		case KEY_END:
-			if(E.cy < E.numrows) E.cx = E.row[E.cy].size;
-			break;
-		case 338:
-		case 339:
-			int times = E.rows;
-			if(c == 339) {
-				E.cy = E.rowoff;
-				while(times--)
-					if(E.cy != 0) E.cy--;
-				break;
-			}
-			else if(c == 338) {
-				E.cy = E.rowoff + E.rows - 1;
-				if(E.cy > E.numrows) E.cy = E.numrows;
-				while(times--)
-					if(E.cy < E.numrows) E.cy++;
-				break;
-			}
-			break;
+void diffJump(int dir) {
+	if(!E.diff.enabled || E.numrows == 0) return;
+	while(diffTick(LLONG_MAX));
+	int i = E.cy < E.numrows ? E.cy : E.numrows - 1;
+	while(i >= 0 && i < E.numrows && editorRow(i)->diff != DIFF_SAME) i += dir;
+	while(i >= 0 && i < E.numrows && editorRow(i)->diff == DIFF_SAME) i += dir;
+	if(i < 0 || i >= E.numrows) {
+		editorSetStatusMsg("No more changes");
+		return;
 	}
+	while(dir < 0 && i > 0 && editorRow(i - 1)->diff != DIFF_SAME) i--;
+	E.cy = i;
+	E.cx = 0;
 }
 
-void editorProcessKeypress() {
-	MEVENT event;
-	static int quit_times = QUIT_TIMES;
-	erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-	int c = getch();
+unsigned long long sessionHash(const unsigned char *s, long long len) {
+	unsigned long long h = 14695981039346656037ull;
+	for(long long i = 0; i < len; i++)
+		h = (h ^ s[i]) * 1099511628211ull;
+	return h;
+}
 
-	switch(c) {
-		case ctrl('q'):
-			if(E.dirty && quit_times > 0) {
-				editorSetStatusMsg("Unsaved file. Press Ctrl-Q once more to quit");
-				quit_times--;
-				return;
-			}
-			endwin();
-			exit(0);
-			break;
-		case ctrl('s'):
-			editorSave();
-			break;
-		case ctrl('z'):
-			undo(&E.u, &E.r);
-			break;
-		case ctrl('y'):
-			redo(&E.u, &E.r);
-			break;
-		case KEY_HOME:
-			editorMoveCursor(c);
-			break;
-		case KEY_END:
-			editorMoveCursor(c);
-			break;
-		case 338:
-		case 339:
-			editorMoveCursor(c);
-				break;
-		case ctrl('f'):
-			editorFind();
-			break;
-		case KEY_ENTER:
-		case ctrl('j'):
-			editorInsertNewline(1);
-			break;
-		case KEY_BACKSPACE:
-		case ctrl('h'):
-		case KEY_DC:
-			if(c == KEY_DC) {
-				if(row && E.cx < row->size) E.cx++;
-				else if(row && E.cx == row->size) {
-					E.cy++;
-					E.cx = 0;
-				}
-			}
-			editorDelChar(1);
-			break;
-		case KEY_LEFT:
-			editorMoveCursor(c);
-			break;
-		case KEY_RIGHT:
-			editorMoveCursor(c);
-			break;
-		case KEY_UP:
-			editorMoveCursor(c);
-			break;
-		case KEY_DOWN:
-			editorMoveCursor(c);
-			break;
-		case 27:
-			int ch = getch();
-			if(ch == -1) break;
-			else {
-				switch(ch) {
-					case 'j': editorMoveCursor(KEY_UP); break;
-					case 'h': editorMoveCursor(KEY_LEFT); break;
-					case 'k': editorMoveCursor(KEY_DOWN); break;
-					case 'l': editorMoveCursor(KEY_RIGHT); break;
-					case 'n': editorMoveCursor(KEY_HOME); break;
-					case 'm': editorMoveCursor(KEY_END); break;
-				}
-			}
-			break;
-		case KEY_MOUSE:
-			if(c == KEY_MOUSE) {
-				if(getmouse(&event) == OK) {
-					if(event.bstate & BUTTON4_PRESSED)
-						editorMoveCursor(KEY_UP);
-					else if(event.bstate & BUTTON5_PRESSED)
-						editorMoveCursor(KEY_DOWN);
-					else {
-						E.cy = event.y + E.rowoff;
-						E.rx = event.x + E.line_width;
-						E.cx = editorRowRxToCx(&E.row[E.cy], event.x - E.line_width - 1);
-					}
-				}
-			}
-		default:
-			if(isPrintable(c))
-				editorInsertChar(1, c);
-			break;
+unsigned char *sessionPutVarint(unsigned char *p, unsigned long long v) {
+	while(v >= 0x80) {
+		*p++ = (v & 0x7f) | 0x80;
+		v >>= 7;
 	}
+	*p++ = v;
+	return p;
+}
 
-	row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-	int rowlen = row ? row->size : 0;
-	if(E.cx > rowlen)
-		E.cx = rowlen;
+const unsigned char *sessionGetVarint(const unsigned char *p, const unsigned char *end, unsigned long long *v) {
+	*v = 0;
+	for(int shift = 0; p < end && shift < 64; shift += 7) {
+		*v |= (unsigned long long)(*p & 0x7f) << shift;
+		if(!(*p++ & 0x80)) return p;
+	}
+	return NULL;
+}
 
-	quit_times = QUIT_TIMES;
+char *sessionPath(const char *filename, char **real, int create) {
+	const char *base = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+	char dir[PATH_MAX];
+	if(base && *base)
+		snprintf(dir, sizeof(dir), "%s/%s", base, SESSION_DIR);
+	else if(home && *home)
+		snprintf(dir, sizeof(dir), "%s/.cache/%s", home, SESSION_DIR);
+	else
+		return NULL;
+	*real = realpath(filename, NULL);
+	if(*real == NULL) return NULL;
+	if(create) {
+		char *slash = strrchr(dir, '/');
+		*slash = '\0';
+		mkdir(dir, 0700);
+		*slash = '/';
+		mkdir(dir, 0700);
+	}
+	unsigned long long h = sessionHash((const unsigned char *)*real, strlen(*real));
+	char *path = malloc(strlen(dir) + 18);
+	sprintf(path, "%s/%016llx", dir, h);
+	return path;
 }
 
-void getWindowSize(int *rows, int *cols) {
-	getmaxyx(stdscr, *cols, *rows);
-	E.rows -= 2;
+int *sessionScan(int fd, struct stat *st, int *numrows, unsigned int **hashes) {
+	long long size = st->st_size, off = 0;
+	const char *map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	if(map == MAP_FAILED) return NULL;
+	int n = 0, cap = 0, *lens = NULL;
+	while(off < size) {
+		const char *nl = memchr(map + off, '\n', size - off);
+		long long end = nl ? nl - map + 1 : size, len = end - off;
+		while(len > 0 && (map[off + len - 1] == '\n' || map[off + len - 1] == '\r'))
+			len--;
+		if(len > INT_MAX || n == INT_MAX / 2) {
+			free(lens);
+			munmap((void *)map, size);
+			return NULL;
+		}
+		if(2 * n + 2 > cap) {
+			cap = cap ? 2 * cap : 1024;
+			lens = realloc(lens, sizeof(int) * cap);
+		}
+		lens[2 * n] = len;
+		lens[2 * n + 1] = end - off - len;
+		n++;
+		off = end;
+	}
+
+	*hashes = malloc(sizeof(unsigned int) * (n + 1));
+	off = 0;
+	for(int i = 0; i < n; i++) {
+		(*hashes)[i] = diffHash(map + off, lens[2 * i]);
+		off += lens[2 * i] + lens[2 * i + 1];
+	}
+	if(map) munmap((void *)map, size);
+	if(lens == NULL) lens = malloc(sizeof(int));
+	*numrows = n;
+	return lens;
 }
 
-void initEditor() {
-	E.cx = 0;
-	E.cy = 0;
-	E.rx = 0;
-	E.rowoff = 0;
-	E.numrows = 0;
-	E.line_width = 0;
-	E.coloff = 0;
-	E.row = NULL;
-	E.dirty = 0;
-	E.filename = NULL;
-	E.statusmsg[0] = '\0';
-	E.statusmsg_time = 0;
-	E.u.top = E.r.top = NULL;
-	initscr();
-	start_color();
-	clear();
-	raw();
-	keypad(stdscr, TRUE);
-	noecho();
-	scrollok(stdscr, FALSE);
-	mousemask(ALL_MOUSE_EVENTS, NULL);
+unsigned char *sessionEncode(const char *real, int fd, struct stat *st, long long *buflen) {
+	diffstate *d = &E.diff;
+	unsigned int *hashes = NULL;
+	int n = 0, *lens = NULL;
+	int cached = !E.dirty && d->plain && d->base == NULL && d->numdisk == E.numrows &&
+		d->st.st_size == st->st_size && d->st.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+		d->st.st_mtim.tv_nsec == st->st_mtim.tv_nsec && d->st.st_ino == st->st_ino && d->st.st_dev == st->st_dev;
+	if(cached) {
+		long long total = 0;
+		n = E.numrows;
+		lens = malloc(sizeof(int) * (2 * n + 1));
+		for(int i = 0; i < n; i++) {
+			lens[2 * i] = editorRow(i)->size;
+			lens[2 * i + 1] = 1;
+			total += lens[2 * i] + 1;
+		}
+		if(total != st->st_size) {
+			free(lens);
+			cached = 0;
+		}
+	}
+	if(!cached) {
+		lens = sessionScan(fd, st, &n, &hashes);
+		if(lens == NULL) return NULL;
+	}
+
+	int consistent = cached || (!E.dirty && n == E.numrows);
+	for(int i = 0; !cached && consistent && i < n; i++) {
+		erow *row = editorRow(i);
+		consistent = row->hashed && row->hash == hashes[i] && row->size == lens[2 * i];
+	}
+	brackettree *b = &E.brackets;
+	sessionhdr h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SESSION_MAGIC, sizeof(h.magic));
+	h.size = st->st_size;
+	h.mtime = st->st_mtim.tv_sec;
+	h.mtimensec = st->st_mtim.tv_nsec;
+	h.ino = st->st_ino;
+	h.dev = st->st_dev;
+	h.cx = E.cx;
+	h.cy = E.cy;
+	h.rowoff = E.rowoff;
+	h.coloff = E.coloff;
+	h.numrows = n;
+	h.numleaves = consistent && b->valid ? b->numleaves : 0;
+	h.pathlen = strlen(real);
+
+	unsigned char *buf = malloc(sizeof(h) + h.pathlen + 14LL * n + sizeof(bracketsum) * h.numleaves + 8);
+	unsigned char *p = buf;
+	memcpy(p, &h, sizeof(h));
+	p += sizeof(h);
+	memcpy(p, real, h.pathlen);
+	p += h.pathlen;
+	for(int i = 0; i < 2 * n; i++)
+		p = sessionPutVarint(p, lens[i]);
+	memcpy(p, cached ? d->disk : hashes, sizeof(unsigned int) * n);
+	p += sizeof(unsigned int) * n;
+	if(h.numleaves)
+		memcpy(p, &b->node[b->size], sizeof(bracketsum) * h.numleaves);
+	p += sizeof(bracketsum) * h.numleaves;
+	unsigned long long sum = sessionHash(buf, p - buf);
+	memcpy(p, &sum, sizeof(sum));
+	p += sizeof(sum);
+	free(lens);
+	free(hashes);
+	*buflen = p - buf;
+	return buf;
+}
+
+int sessionDecode(const unsigned char *buf, long long len, const char *real, int fd, struct stat *st) {
+	sessionhdr h;
+	unsigned long long sum;
+	if(len < (long long)(sizeof(h) + sizeof(sum))) return 0;
+	memcpy(&h, buf, sizeof(h));
+	memcpy(&sum, buf + len - sizeof(sum), sizeof(sum));
+	if(memcmp(h.magic, SESSION_MAGIC, sizeof(h.magic)) || h.size != st->st_size ||
+			h.mtime != st->st_mtim.tv_sec || h.mtimensec != st->st_mtim.tv_nsec ||
+			h.ino != st->st_ino || h.dev != st->st_dev)
+		return 0;
+	const unsigned char *p = buf + sizeof(h), *end = buf + len - sizeof(sum);
+	if(h.pathlen != (int)strlen(real) || h.pathlen > end - p || memcmp(p, real, h.pathlen))
+		return 0;
+	p += h.pathlen;
+	if(h.numrows < 0 || h.numleaves < 0 || 6LL * h.numrows + (long long)sizeof(bracketsum) * h.numleaves > end - p)
+		return 0;
+	if(sum != sessionHash(buf, len - sizeof(sum))) return 0;
+
+	int *lens = malloc(sizeof(int) * (2 * h.numrows + 1));
+	long long total = 0;
+	for(int i = 0; p && i < 2 * h.numrows; i++) {
+		unsigned long long v;
+		p = sessionGetVarint(p, end, &v);
+		if(p && v > INT_MAX) p = NULL;
+		lens[i] = v;
+		total += v;
+	}
+	int ok = p && total == h.size && end - p == 4LL * h.numrows + (long long)sizeof(bracketsum) * h.numleaves;
+	const bracketsum *leaves = ok ? (const bracketsum *)(p + 4LL * h.numrows) : NULL;
+	long long leafrows = 0;
+	for(int i = 0; ok && i < h.numleaves; i++) {
+		bracketsum leaf;
+		memcpy(&leaf, &leaves[i], sizeof(leaf));
+		leafrows += leaf.rows;
+	}
+	const char *map = NULL;
+	if(ok && h.size > 0) {
+		map = mmap(NULL, h.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map == MAP_FAILED) ok = 0;
+	}
+	if(!ok) {
+		free(lens);
+		return 0;
+	}
+
+	long long off = 0;
+	int coldfrom = COLD_HOT_ROWS, coldbytes = 0, plain = 1;
+	for(int i = 0; i < h.numrows; i++) {
+		erow loaded, *row = &loaded;
+		if(lens[2 * i + 1] != 1) plain = 0;
+		row->size = lens[2 * i];
+		row->chars = memAlloc(MEM_TEXT, row->size + 1);
+		memcpy(row->chars, map + off, row->size);
+		row->chars[row->size] = '\0';
+		off += lens[2 * i] + lens[2 * i + 1];
+		row->rsize = 0;
+		row->ascii = 0;
+		row->render = NULL;
+		row->hl = NULL;
+		row->cold = NULL;
+		row->coldoff = 0;
+		row->gen = E.gen;
+		row->indexed = 0;
+		row->stamp = E.tick;
+		memcpy(&row->hash, p + 4LL * i, sizeof(row->hash));
+		row->hashed = 1;
+		row->diff = DIFF_SAME;
+		row->wrapw = -1;
+		row->disk = i;
+		editorRowsSplice(i, 0, row, 1);
+		E.numrows = i + 1;
+		if(E.coldenabled && E.numrows > COLD_HOT_ROWS) {
+			coldbytes += row->size;
+			if(coldbytes >= COLD_BLOCK_BYTES) {
+				editorFreezeRows(coldfrom, E.numrows);
+				coldfrom = E.numrows;
+				coldbytes = 0;
+			}
+		}
+	}
+	if(map) munmap((void *)map, h.size);
+	free(lens);
+
+	E.bytes.valid = 0;
+	E.wrap.valid = 0;
+	editorIndexReset();
+	diffstate *d = &E.diff;
+	d->disk = memAlloc(MEM_INDEX, sizeof(unsigned int) * (E.numrows + 1));
+	for(int i = 0; i < E.numrows; i++)
+		d->disk[i] = editorRow(i)->hash;
+	d->numdisk = E.numrows;
+	d->plain = plain;
+	d->st = *st;
+	if(h.numleaves > 0 && leafrows == E.numrows) {
+		brackettree *b = &E.brackets;
+		bracketBuildNodes(h.numleaves);
+		memcpy(&b->node[b->size], leaves, sizeof(bracketsum) * h.numleaves);
+		bracketBuildNodes(h.numleaves);
+		b->valid = 1;
+		b->version++;
+	}
 
-	init_color(COLOR_CYAN, 188, 188, 211);
-	init_color(COLOR_RED, 1000, 0, 0);
-	init_color(COLOR_BLUE, 188, 737, 929);
+	E.cy = h.cy < 0 ? 0 : h.cy > E.numrows ? E.numrows : h.cy;
+	E.cx = E.cy < E.numrows && h.cx > 0 ? editorRowSnapCx(editorRowAt(E.cy), h.cx) : 0;
+	E.rowoff = h.rowoff < 0 ? 0 : h.rowoff > E.cy ? E.cy : h.rowoff;
+	E.coloff = h.coloff < 0 ? 0 : h.coloff;
+	return 1;
+}
 
-	init_pair(1, COLOR_BLACK, COLOR_WHITE);
-	init_pair(2, COLOR_BLUE, COLOR_CYAN);
-	init_pair(3, COLOR_YELLOW, COLOR_CYAN);
-	init_pair(4, COLOR_GREEN, COLOR_CYAN);
-	init_pair(5, COLOR_WHITE, COLOR_CYAN);
-	init_pair(6, COLOR_RED, COLOR_CYAN);
-	init_pair(10, COLOR_WHITE, COLOR_CYAN);
+int sessionLoad(const char *filename, int fd, struct stat *st) {
+	char *real = NULL, *path = sessionPath(filename, &real, 0);
+	unsigned char *buf = NULL;
+	long long len = 0;
+	FILE *fp = path ? fopen(path, "rb") : NULL;
+	if(fp) {
+		if(fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0) {
+			buf = malloc(len);
+			rewind(fp);
+			if(fread(buf, 1, len, fp) != (size_t)len) len = 0;
+		}
+		fclose(fp);
+	}
+	int ok = buf && sessionDecode(buf, len, real, fd, st);
+	free(buf);
+	free(real);
+	free(path);
+	return ok;
+}
 
-	bkgd(COLOR_PAIR(10));
-	getWindowSize(&E.cols, &E.rows);
+void sessionSave() {
+	if(E.pager || E.filename == NULL) return;
+	char *real = NULL, *path = sessionPath(E.filename, &real, 1);
+	int fd = path ? open(E.filename, O_RDONLY) : -1;
+	struct stat st;
+	long long len;
+	unsigned char *buf = NULL;
+	if(fd != -1 && fstat(fd, &st) == 0)
+		buf = sessionEncode(real, fd, &st, &len);
+	if(buf) {
+		char *tmp = malloc(strlen(path) + 24);
+		sprintf(tmp, "%s.%d", path, (int)getpid());
+		FILE *fp = fopen(tmp, "wb");
+		if(fp && fwrite(buf, 1, len, fp) == (size_t)len && fclose(fp) == 0)
+			rename(tmp, path);
+		else {
+			if(fp) fclose(fp);
+			unlink(tmp);
+		}
+		free(tmp);
+		free(buf);
+	}
+	if(fd != -1) close(fd);
+	free(real);
+	free(path);
 }
 
-void editorUpdateRow(erow *row) {
-	int tabs = 0;
-	for(int j = 0; j < row->size; j++)
-		if(row->chars[j] == '\t') tabs++;
+void filterAddRow(filterjob *f, const char *s, int len) {
+	if(f->numrows == f->cap) {
+		f->cap = f->cap ? f->cap * 2 : 1024;
+		f->rows = memRealloc(MEM_UNDO, f->rows, sizeof(erow) * (f->cap + 1));
+	}
+	erow *row = &f->rows[f->numrows++];
+	memset(row, 0, sizeof(erow));
+	row->size = len;
+	row->chars = memAlloc(MEM_TEXT, len + 1);
+	memcpy(row->chars, s, len);
+	row->chars[len] = '\0';
+	row->gen = E.gen;
+	row->stamp = E.tick;
+	row->diff = DIFF_SAME;
+	row->disk = -1;
+	row->wrapw = -1;
+}
 
-	free(row->render);
-	row->render = malloc(row->size + tabs * (TAB_STOP - 1) + 1);
+int filterWrite(filterjob *f) {
+	struct iovec iov[FILTER_IOV];
+	coldblock *blk = NULL;
+	int cnt = 0;
+	for(int at = f->row, off = f->off; at < f->end && cnt + 2 <= FILTER_IOV; at++, off = 0) {
+		coldblock *cold = editorRow(at)->cold;
+		if(cold) {
+			if(blk && cold != blk) break;
+			blk = cold;
+		}
+		int len;
+		const char *chars = editorRowPeek(at, &len);
+		if(off < len) {
+			iov[cnt].iov_base = (char *)&chars[off];
+			iov[cnt++].iov_len = len - off;
+		}
+		iov[cnt].iov_base = "\n";
+		iov[cnt++].iov_len = 1;
+	}
+	ssize_t n = writev(f->in, iov, cnt);
+	if(n < 0) return errno == EAGAIN || errno == EINTR ? 1 : -1;
+	while(n > 0) {
+		int left = editorRow(f->row)->size + 1 - f->off;
+		if(n < left) {
+			f->off += n;
+			break;
+		}
+		n -= left;
+		f->row++;
+		f->off = 0;
+	}
+	return f->row < f->end;
+}
 
-	int idx = 0;
-	for(int j = 0; j < row->size; j++) {
-		if(row->chars[j] == '\t') {
-			row->render[idx++] = ' ';
-			while(idx % TAB_STOP != 0) row->render[idx++] = ' ';
+int filterRead(filterjob *f) {
+	char buf[FILTER_BUF];
+	ssize_t n = read(f->out, buf, sizeof(buf));
+	if(n < 0) return errno == EAGAIN || errno == EINTR ? 1 : 0;
+	if(n == 0) return 0;
+	const char *p = buf, *end = buf + n, *nl;
+	while(p < end) {
+		nl = memchr(p, '\n', end - p);
+		int len = (nl ? nl : end) - p;
+		if(nl && f->linelen == 0) {
+			filterAddRow(f, p, len);
 		}
 		else {
-			row->render[idx++] = row->chars[j];
+			if(f->linelen + len > f->linecap) {
+				while(f->linelen + len > f->linecap)
+					f->linecap = f->linecap ? f->linecap * 2 : 256;
+				f->line = realloc(f->line, f->linecap);
+			}
+			memcpy(&f->line[f->linelen], p, len);
+			f->linelen += len;
+			if(nl) {
+				filterAddRow(f, f->line, f->linelen);
+				f->linelen = 0;
+			}
 		}
+		p += len + (nl != NULL);
 	}
-	row->render[idx] = '\0';
-	row->rsize = idx;
+	return 1;
 }
 
-void editorInsertRow(int at, char *s, size_t len) {
-	if(at < 0 || at > E.numrows) return;
-	E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-	memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at));
+void filterReadErr(filterjob *f) {
+	char buf[FILTER_ERR];
+	ssize_t n = read(f->err, buf, sizeof(buf));
+	if(n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+	if(n <= 0) {
+		close(f->err);
+		f->err = -1;
+		return;
+	}
+	for(int i = 0; i < n && f->errlen < FILTER_ERR - 1; i++) {
+		if(buf[i] == '\n') {
+			f->errlen = FILTER_ERR - 1;
+			break;
+		}
+		f->errmsg[f->errlen++] = buf[i];
+	}
+	f->errmsg[f->errlen] = '\0';
+}
 
-	E.row[at].size = len;
-	E.row[at].chars = malloc(len + 1);
-	memcpy(E.row[at].chars, s, len);
-	E.row[at].chars[len] = '\0';
+int filterStart(filterjob *f, const char *cmd) {
+	int in[2], out[2], err[2];
+	if(pipe2(in, O_CLOEXEC) == -1) return -1;
+	if(pipe2(out, O_CLOEXEC) == -1) {
+		close(in[0]);
+		close(in[1]);
+		return -1;
+	}
+	if(pipe2(err, O_CLOEXEC) == -1) {
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+	f->pid = fork();
+	if(f->pid == 0) {
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		signal(SIGPIPE, SIG_DFL);
+		setpgid(0, 0);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+	close(in[0]);
+	close(out[1]);
+	close(err[1]);
+	if(f->pid > 0)
+		setpgid(f->pid, f->pid);
+	if(f->pid == -1) {
+		close(in[1]);
+		close(out[0]);
+		close(err[0]);
+		return -1;
+	}
+	f->in = in[1];
+	f->out = out[0];
+	f->err = err[0];
+	fcntl(f->in, F_SETFL, O_NONBLOCK);
+	fcntl(f->out, F_SETFL, O_NONBLOCK);
+	fcntl(f->err, F_SETFL, O_NONBLOCK);
+	return 0;
+}
 
-	E.row[at].rsize = 0;
-	E.row[at].render = NULL;
-	editorUpdateRow(&E.row[at]);
+void editorToggleMark() {
+	if(E.mark != -1) {
+		E.mark = -1;
+		editorSetStatusMsg("Mark cleared");
+		return;
+	}
+	E.mark = E.cy;
+	editorSetStatusMsg("Mark set at line %d", E.cy + 1);
+}
 
-	E.numrows++;
-	E.dirty = 1;
+void editorFilter() {
+	int from = 0, to = E.numrows;
+	if(E.mark != -1) {
+		from = E.mark < E.cy ? E.mark : E.cy;
+		to = (E.mark < E.cy ? E.cy : E.mark) + 1;
+		if(from > E.numrows) from = E.numrows;
+		if(to > E.numrows) to = E.numrows;
+	}
+	char *cmd = editorPrompt(from == 0 && to == E.numrows ? "Filter buffer through: %s" : "Filter lines through: %s", NULL);
+	if(cmd == NULL) return;
+	filterRun(cmd, from, to);
+	free(cmd);
 }
 
-void editorFreeRow(erow *row) {
-	free(row->render);
-	free(row->chars);
+void filterRun(const char *cmd, int from, int to) {
+	filterjob f;
+	memset(&f, 0, sizeof(filterjob));
+	f.row = from;
+	f.end = to;
+	if(filterStart(&f, cmd) == -1) {
+		editorSetStatusMsg("Can't run filter: %s", strerror(errno));
+		return;
+	}
+	if(f.row == f.end) {
+		close(f.in);
+		f.in = -1;
+	}
+	int cancelled = 0, status = 0, keys[FILTER_KEYS], numkeys = 0;
+	long long next = editorNow() + FILTER_POLL_MS * 1000LL;
+	while(f.out != -1) {
+		struct pollfd pfd[4] = {{f.in, POLLOUT, 0}, {f.out, POLLIN, 0}, {f.err, POLLIN, 0}, {numkeys < FILTER_KEYS ? STDIN_FILENO : -1, POLLIN, 0}};
+		poll(pfd, 4, FILTER_POLL_MS);
+		if(pfd[3].revents & POLLIN) {
+			timeout(0);
+			int c = getch();
+			timeout(SAVE_POLL_MS);
+			if(c == 27 || c == ctrl('c')) {
+				cancelled = 1;
+				break;
+			}
+			if(c != ERR)
+				keys[numkeys++] = c;
+		}
+		if(pfd[0].revents && filterWrite(&f) <= 0) {
+			close(f.in);
+			f.in = -1;
+		}
+		if(pfd[1].revents && filterRead(&f) == 0) {
+			close(f.out);
+			f.out = -1;
+		}
+		if(pfd[2].revents)
+			filterReadErr(&f);
+		if(editorNow() >= next) {
+			editorSetStatusMsg("%s: %d of %d lines sent, %d received (Esc cancels)", cmd, f.row - from, to - from, f.numrows);
+			editorRefreshScreen();
+			next = editorNow() + FILTER_POLL_MS * 1000LL;
+		}
+	}
+	while(numkeys > 0)
+		ungetch(keys[--numkeys]);
+	if(f.in != -1) close(f.in);
+	if(f.out != -1) close(f.out);
+	if(cancelled) {
+		kill(-f.pid, SIGTERM);
+		long long deadline = editorNow() + FILTER_KILL_MS * 1000LL;
+		while(waitpid(f.pid, &status, WNOHANG) == 0) {
+			if(editorNow() >= deadline) {
+				kill(-f.pid, SIGKILL);
+				waitpid(f.pid, &status, 0);
+				break;
+			}
+			usleep(10000);
+		}
+	}
+	else
+		waitpid(f.pid, &status, 0);
+	if(f.err != -1) filterReadErr(&f);
+	if(f.err != -1) close(f.err);
+	if(f.linelen)
+		filterAddRow(&f, f.line, f.linelen);
+	free(f.line);
+
+	if(cancelled || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		for(int i = 0; i < f.numrows; i++)
+			memFree(MEM_TEXT, f.rows[i].chars);
+		memFree(MEM_UNDO, f.rows);
+		if(cancelled)
+			editorSetStatusMsg("Filter cancelled");
+		else if(WIFEXITED(status))
+			editorSetStatusMsg("%s exited with status %d%s%s", cmd, WEXITSTATUS(status), f.errlen ? ": " : "", f.errmsg);
+		else
+			editorSetStatusMsg("%s killed by signal %d", cmd, WTERMSIG(status));
+		return;
+	}
+	undonode *n = editorUndoRecord(UNDO_BULK, 0, 0, from);
+	n->rows = f.rows;
+	n->numrows = f.numrows;
+	n->len = to - from;
+	editorUndoApply(n, 1);
+	E.mark = -1;
+	editorSetStatusMsg("Filtered %d lines through %s into %d", to - from, cmd, f.numrows);
 }
 
-void editorDelRow(int at) {
-	if (at < 0 || at >= E.numrows) return;
-	editorFreeRow(&E.row[at]);
-	memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numrows - at - 1));
-	E.numrows--;
-	E.dirty = 1;
+void pagerOpen(char *filename) {
+	initEditor();
+	E.filename = strdup(filename);
+	pagerAttach();
 }
 
-char *editorRowsToStr(int *buflen) {
-	int totlen = 0;
-	for(int i = 0; i < E.numrows; i++)
-		totlen += E.row[i].size + 1;
-	*buflen = totlen;
+void pagerAttach() {
+	pager *P = calloc(1, sizeof(pager));
+	P->fd = open(E.filename, O_RDONLY);
+	if(P->fd == -1) die("open");
+	struct stat st;
+	if(fstat(P->fd, &st) == -1) die("fstat");
+	P->size = st.st_size;
+	P->map = NULL;
+	P->topline = 0;
+	P->index = malloc(sizeof(long long) * 64);
+	P->index[0] = 0;
+	P->numindex = 1;
+	pthread_mutex_init(&P->lock, NULL);
+	E.pager = P;
+	if(pthread_create(&P->thread, NULL, pagerIndexThread, P) != 0) die("pthread_create");
+}
 
-	char *buf = malloc(totlen);
-	char *p = buf;
-	for(int i = 0; i < E.numrows; i++) {
-		memcpy(p, E.row[i].chars, E.row[i].size);
-		p += E.row[i].size;
-		*p = '\n';
-		p++;
+void *pagerIndexThread(void *arg) {
+	pager *P = arg;
+	char *buf = malloc(PAGER_CHUNK);
+	long long off = 0, lines = 0;
+	char last = '\n';
+	ssize_t n;
+	while((n = pread(P->fd, buf, PAGER_CHUNK, off)) > 0) {
+		char *p = buf, *end = buf + n;
+		while((p = memchr(p, '\n', end - p)) != NULL) {
+			p++;
+			if(++lines % PAGER_INDEX_STRIDE == 0) {
+				pthread_mutex_lock(&P->lock);
+				if(P->numindex % 64 == 0)
+					P->index = realloc(P->index, sizeof(long long) * (P->numindex + 64));
+				P->index[P->numindex++] = off + (p - buf);
+				pthread_mutex_unlock(&P->lock);
+			}
+		}
+		last = buf[n - 1];
+		off += n;
+		pthread_mutex_lock(&P->lock);
+		P->scanned = off;
+		P->lines = lines;
+		pthread_mutex_unlock(&P->lock);
+	}
+	free(buf);
+	pthread_mutex_lock(&P->lock);
+	P->lines = lines + (last != '\n');
+	P->indexed = 1;
+	pthread_mutex_unlock(&P->lock);
+	return NULL;
+}
+
+const char *pagerWindow(long long off, long long need, long long *avail) {
+	pager *P = E.pager;
+	if(off < P->mapoff || off + need > P->mapoff + P->maplen) {
+		long long page = sysconf(_SC_PAGESIZE);
+		long long start = off - PAGER_WINDOW / 2;
+		if(off + need > start + PAGER_WINDOW) start = off;
+		if(start < 0) start = 0;
+		start -= start % page;
+		long long len = P->size - start;
+		if(len > PAGER_WINDOW) len = PAGER_WINDOW;
+		if(P->map) munmap(P->map, P->maplen);
+		P->map = mmap(NULL, len, PROT_READ, MAP_SHARED, P->fd, start);
+		if(P->map == MAP_FAILED) die("mmap");
+		P->mapoff = start;
+		P->maplen = len;
 	}
+	*avail = P->mapoff + P->maplen - off;
+	return &P->map[off - P->mapoff];
+}
 
-	return buf;
+long long pagerNextLine(long long off) {
+	long long avail;
+	while(off < E.pager->size) {
+		const char *p = pagerWindow(off, 1, &avail);
+		const char *q = memchr(p, '\n', avail);
+		if(q) return off + (q - p) + 1;
+		off += avail;
+	}
+	return E.pager->size;
 }
 
-void editorOpen(char *filename) {
-	initEditor();
-	free(E.filename);
-	E.filename = strdup(filename);
-	FILE *fp = fopen(filename, "r");
-	if(!fp) die("fopen");
+long long pagerLineStart(long long off) {
+	long long avail;
+	while(off > 0) {
+		pagerWindow(off - 1, 1, &avail);
+		long long lo = E.pager->mapoff;
+		const char *q = memrchr(E.pager->map, '\n', off - lo);
+		if(q) return lo + (q - E.pager->map) + 1;
+		off = lo;
+	}
+	return 0;
+}
 
-	char *line = NULL;
-	size_t linecap = 0;
-	ssize_t linelen;
-	while((linelen = getline(&line, &linecap, fp)) != -1) {
-		while(linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-			linelen--;
-		editorInsertRow(E.numrows, line, linelen);
+long long pagerLineNumber(long long off) {
+	pager *P = E.pager;
+	pthread_mutex_lock(&P->lock);
+	if(P->scanned < off) {
+		pthread_mutex_unlock(&P->lock);
+		return -1;
 	}
-	free(line);
-	fclose(fp);
-	E.dirty = 0;
+	long long lo = 0, hi = P->numindex - 1;
+	while(lo < hi) {
+		long long mid = (lo + hi + 1) / 2;
+		if(P->index[mid] <= off) lo = mid;
+		else hi = mid - 1;
+	}
+	long long pos = P->index[lo];
+	pthread_mutex_unlock(&P->lock);
+
+	long long line = lo * PAGER_INDEX_STRIDE, avail;
+	while(pos < off) {
+		const char *p = pagerWindow(pos, 1, &avail);
+		if(avail > off - pos) avail = off - pos;
+		const char *q = memchr(p, '\n', avail);
+		if(!q) break;
+		pos += (q - p) + 1;
+		line++;
+	}
+	return line;
 }
 
-void editorSave() {
-	if(E.filename == NULL) {
-		E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
-		if(E.filename == NULL) {
-			editorSetStatusMsg("Save aborted");
-			return;
+long long pagerLineOffset(long long line) {
+	pager *P = E.pager;
+	pthread_mutex_lock(&P->lock);
+	long long k = line / PAGER_INDEX_STRIDE;
+	if(k >= P->numindex || (P->indexed && line >= P->lines)) {
+		pthread_mutex_unlock(&P->lock);
+		return -1;
+	}
+	long long off = P->index[k];
+	pthread_mutex_unlock(&P->lock);
+	for(long long i = k * PAGER_INDEX_STRIDE; i < line && off < P->size; i++)
+		off = pagerNextLine(off);
+	return off < P->size ? off : -1;
+}
+
+int pagerColumnByte(const char *s, int len, int ascii, int coloff, int *col) {
+	int c = 0, j = 0, cp, n, w;
+	if(ascii && !memchr(s, '\t', len)) {
+		j = coloff < len ? coloff : len;
+		*col = j;
+		return j;
+	}
+	while(j < len) {
+		if(s[j] == '\t') {
+			n = 1;
+			w = TAB_STOP - c % TAB_STOP;
 		}
+		else if(ascii) {
+			n = 1;
+			w = 1;
+		}
+		else {
+			n = utf8Decode(&s[j], len - j, &cp);
+			w = utf8Width(cp);
+		}
+		if(c + w > coloff) break;
+		c += w;
+		j += n;
 	}
+	*col = c;
+	return j;
+}
 
-	int len;
-	char *buf = editorRowsToStr(&len);
-	int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-	if(fd != -1) {
-		if(ftruncate(fd, len) != -1) {
-			if(write(fd, buf, len) != -1) {
-				close(fd);
-				free(buf);
-				E.dirty = 0;
-				editorSetStatusMsg("%d bytes written to disk", len);
-				return;
+void pagerDrawRows(abuf *ab) {
+	pager *P = E.pager;
+	if(P->topline == -1)
+		P->topline = pagerLineNumber(P->top);
+	E.line_width = 0;
+	if(P->topline != -1)
+		E.line_width = (int)log10(P->topline + E.rows) + 1;
+	int width = E.cols - E.line_width - 2;
+	int span = (width > 0 ? width : 0) * 4 + 4;
+	long long need = (long long)E.coloff * 4 + span + 2;
+	char render[span * TAB_STOP];
+	unsigned char hl[span * TAB_STOP];
+	long long off = P->top;
+
+	for(int i = 0; i < E.rows; i++) {
+		if(off >= P->size) {
+			abAppend(ab, "~", 1);
+		}
+		else {
+			if(P->topline != -1) {
+				char line_number_str[E.line_width + 1];
+				snprintf(line_number_str, sizeof(line_number_str), "%*lld ", E.line_width, P->topline + i + 1);
+				abAppendColor(ab, line_number_str, strlen(line_number_str), 6);
+			}
+			abAppend(ab, " ", 1);
+			long long avail;
+			const char *p = pagerWindow(off, need, &avail);
+			if(avail > need) avail = need;
+			const char *nl = memchr(p, '\n', avail);
+			int len = nl ? nl - p : avail;
+			long long next = nl ? off + len + 1 : pagerNextLine(off);
+			if(len > 0 && p[len - 1] == '\r') len--;
+			int ascii = editorIsAscii(p, len), col;
+			int j = pagerColumnByte(p, len, ascii, E.coloff, &col);
+			p += j;
+			len -= j;
+			if(len > span) len = span;
+			if(memchr(p, '\t', len)) {
+				len = editorRenderTabs(p, len, ascii, col, render);
+				p = render;
 			}
+			highlight_buffer(p, len, hl);
+			editorAppendSpan(ab, p, len, ascii, E.coloff - col, width, hl);
+			off = next;
 		}
-		close(fd);
+		abAppend(ab, "\n", 1);
 	}
+}
 
-	free(buf);
-	editorSetStatusMsg("Can't save! I/O error : %s", strerror(errno));
+void pagerDrawStatus(char *status, int *len, char *rstatus, int *rlen) {
+	pager *P = E.pager;
+	pthread_mutex_lock(&P->lock);
+	long long lines = P->lines, scanned = P->scanned;
+	int indexed = P->indexed;
+	pthread_mutex_unlock(&P->lock);
+
+	if(indexed)
+		*len = snprintf(status, 80, "%s - %lld lines [read-only]", E.filename, lines);
+	else
+		*len = snprintf(status, 80, "%s - indexing %lld%% [read-only]", E.filename, P->size ? scanned * 100 / P->size : 100);
+	int pct = P->size ? P->top * 100 / P->size : 100;
+	if(P->topline != -1)
+		*rlen = snprintf(rstatus, 80, "%d%% | %lld/%lld B | %lld", pct, P->top, P->size, P->topline + 1);
+	else
+		*rlen = snprintf(rstatus, 80, "%d%% | %lld/%lld B", pct, P->top, P->size);
 }
 
-void editorFindCallback(char *query, int key) {
-	static int last_match = -1;
+void pagerScroll(int lines) {
+	pager *P = E.pager;
+	while(lines > 0) {
+		long long next = pagerNextLine(P->top);
+		if(next >= P->size) break;
+		P->top = next;
+		if(P->topline != -1) P->topline++;
+		lines--;
+	}
+	while(lines < 0 && P->top > 0) {
+		P->top = pagerLineStart(P->top - 1);
+		if(P->topline != -1) P->topline--;
+		lines++;
+	}
+}
+
+long long pagerSearch(const char *query, long long from, int direction) {
+	pager *P = E.pager;
+	long long qlen = strlen(query), avail;
+	if(direction == 1) {
+		long long off = from;
+		while(off + qlen <= P->size) {
+			const char *p = pagerWindow(off, qlen, &avail);
+			const char *m = memmem(p, avail, query, qlen);
+			if(m) return off + (m - p);
+			off += avail - qlen + 1;
+		}
+		return -1;
+	}
+	long long end = from;
+	while(end > 0) {
+		long long start = end - PAGER_WINDOW / 2;
+		if(start < 0) start = 0;
+		long long span = end - start + qlen - 1;
+		if(start + span > P->size) span = P->size - start;
+		const char *p = pagerWindow(start, span, &avail);
+		const char *m, *last = NULL;
+		for(m = p; (m = memmem(m, span - (m - p), query, qlen)) != NULL && start + (m - p) < end; m++)
+			last = m;
+		if(last) return start + (last - p);
+		end = start;
+	}
+	return -1;
+}
+
+void pagerFindCallback(char *query, int key) {
+	static long long last_match = -1;
 	static int direction = 1;
+	pager *P = E.pager;
 
 	if(key == 10 || key == 27) {
 		last_match = -1;
 		direction = 1;
 		return;
-	} 
+	}
 	else if(key == KEY_RIGHT || key == KEY_DOWN) {
 		direction = 1;
 	}
@@ -973,59 +6275,264 @@ void editorFindCallback(char *query, int key) {
 		last_match = -1;
 		direction = 1;
 	}
+	if(query[0] == '\0') return;
 
+	long long from = last_match == -1 ? P->top : (direction == 1 ? last_match + 1 : last_match);
 	if(last_match == -1) direction = 1;
-	int current = last_match;
-
-	for(int i = 0; i < E.numrows; i++) {
-		current += direction;
-		if(current == -1) current = E.numrows - 1;
-		else if(current == E.numrows) current = 0;
-
-		erow *row = &E.row[current];
-		char *match = strstr(row->render, query);
-		if(match) {
-			last_match = current;
-			E.cy = current;
-			E.cx = editorRowRxToCx(row, match - row->render);
-			E.rowoff = E.numrows;
-			break;
-		}
+	long long match = pagerSearch(query, from, direction);
+	if(match == -1)
+		match = pagerSearch(query, direction == 1 ? 0 : P->size, direction);
+	if(match == -1) return;
+
+	last_match = match;
+	P->top = pagerLineStart(match);
+	P->topline = -1;
+	long long bytes = match - P->top;
+	int col = PAGER_MAX_COLUMN;
+	if(bytes < PAGER_MAX_COLUMN) {
+		long long avail;
+		const char *p = pagerWindow(P->top, bytes, &avail);
+		pagerColumnByte(p, bytes, editorIsAscii(p, bytes), INT_MAX, &col);
 	}
+	int width = E.cols - E.line_width - 2;
+	E.coloff = col < width ? 0 : col - width / 2;
+	if(E.coloff > PAGER_MAX_COLUMN) E.coloff = PAGER_MAX_COLUMN;
 }
 
-void editorFind() {
-	int saved_cx = E.cx;
-	int saved_cy = E.cy;
+void pagerFind() {
+	pager *P = E.pager;
+	long long saved_top = P->top, saved_topline = P->topline;
 	int saved_coloff = E.coloff;
-	int saved_rowoff = E.rowoff;
 
-	char *query = editorPrompt("Search: %s (Use ESC/Arrow/Enter)", editorFindCallback);
+	char *query = editorPrompt("Search: %s (Use ESC/Arrow/Enter)", pagerFindCallback);
 	if(query)
 		free(query);
 	else {
-		E.cx = saved_cx;
-		E.cy = saved_cy;
+		P->top = saved_top;
+		P->topline = saved_topline;
 		E.coloff = saved_coloff;
-		E.rowoff = saved_rowoff;
 	}
 }
 
+void pagerGoto() {
+	pager *P = E.pager;
+	char *query = editorPrompt("Goto: %s (line, @byte offset or N%)", NULL);
+	if(query == NULL) return;
+
+	char *end;
+	size_t qlen = strlen(query);
+	if(query[0] == '@' || query[qlen - 1] == '%') {
+		long long off;
+		if(query[0] == '@')
+			off = strtoll(&query[1], &end, 0);
+		else {
+			double pct = strtod(query, &end);
+			off = P->size * pct / 100;
+			if(end == &query[qlen - 1]) end++;
+		}
+		if(*end != '\0' || off < 0 || off > P->size) {
+			editorSetStatusMsg("Invalid position: %s", query);
+		}
+		else {
+			if(off == P->size && off > 0) off--;
+			P->top = pagerLineStart(off);
+			P->topline = -1;
+			E.coloff = 0;
+		}
+	}
+	else {
+		long long line = strtoll(query, &end, 10);
+		long long off = (*end == '\0' && line >= 1) ? pagerLineOffset(line - 1) : -1;
+		if(off == -1) {
+			editorSetStatusMsg("Line not available (yet): %s", query);
+		}
+		else {
+			P->top = off;
+			P->topline = line - 1;
+			E.coloff = 0;
+		}
+	}
+	free(query);
+}
+
+void pagerProcessKeypress(int c) {
+	pager *P = E.pager;
+	switch(c) {
+		case ctrl('q'):
+			endwin();
+			exit(0);
+			break;
+		case ctrl('f'):
+			pagerFind();
+			break;
+		case ctrl('g'):
+			pagerGoto();
+			break;
+		case KEY_UP:
+			pagerScroll(-1);
+			break;
+		case KEY_DOWN:
+			pagerScroll(1);
+			break;
+		case 339:
+			pagerScroll(-E.rows);
+			break;
+		case 338:
+			pagerScroll(E.rows);
+			break;
+		case KEY_LEFT:
+			if(E.coloff > 0) E.coloff--;
+			break;
+		case KEY_RIGHT:
+			if(E.coloff < PAGER_MAX_COLUMN) E.coloff++;
+			break;
+		case KEY_HOME:
+			P->top = 0;
+			P->topline = 0;
+			E.coloff = 0;
+			break;
+		case KEY_END:
+			P->top = P->size;
+			P->topline = -1;
+			pagerScroll(-E.rows);
+			break;
+		case KEY_MOUSE: {
+			MEVENT event;
+			if(getmouse(&event) == OK) {
+				if(event.bstate & BUTTON4_PRESSED)
+					pagerScroll(-1);
+				else if(event.bstate & BUTTON5_PRESSED)
+					pagerScroll(1);
+			}
+			break;
+		}
+		default:
+			if(isPrintable(c) || c == ctrl('s') || c == ctrl('h') || c == KEY_BACKSPACE || c == KEY_DC || c == 10)
+				editorSetStatusMsg("File is open read-only");
+			break;
+	}
+}
+
+long long editorNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+int editorIdleRows(long long deadline) {
+	if(E.pager) return 0;
+	int from[2] = {E.rowoff + E.rows, E.rowoff - E.rows};
+	int did = 0;
+	for(int k = 0; k < 2; k++) {
+		for(int i = from[k]; i < from[k] + E.rows; i++) {
+			if(i < 0 || i >= E.numrows) continue;
+			erow *row = editorRow(i);
+			if(row->hl) continue;
+			editorRowSyntax(i);
+			did = 1;
+			if(editorNow() >= deadline) return 1;
+		}
+	}
+	return did;
+}
+
+int (*idletasks[])(long long) = {
+	diffTick,
+	editorIdleRows,
+	bracketBuild,
+	editorIndexTick,
+	editorUndoCompact
+};
+
+#define NUM_IDLE_TASKS (sizeof(idletasks) / sizeof(idletasks[0]))
+
+void editorIdle() {
+	timeout(0);
+	int c = getch();
+	timeout(SAVE_POLL_MS);
+	if(c != ERR) {
+		ungetch(c);
+		return;
+	}
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	while(poll(&pfd, 1, 0) == 0) {
+		long long deadline = editorNow() + IDLE_SLICE_US;
+		unsigned int i = 0;
+		while(i < NUM_IDLE_TASKS && !idletasks[i](deadline)) i++;
+		if(i == NUM_IDLE_TASKS) return;
+	}
+}
+
+#ifndef TEXTEDITOR_NO_MAIN
 int main(int argc, char *argv[]) {
+	int interval = AUTOSAVE_INTERVAL;
+	int readonly = 0;
+	int opt;
+	int wrap = 0;
+	while((opt = getopt(argc, argv, "a:m:pr:w")) != -1) {
+		switch(opt) {
+			case 'a':
+				interval = atoi(optarg);
+				break;
+			case 'm':
+				if(memParse(optarg)) break;
+				fprintf(stderr, "Bad memory budget %s\n", optarg);
+				exit(1);
+			case 'p':
+				readonly = 1;
+				break;
+			case 'r':
+				E.vt.enabled = strcmp(optarg, "vt") == 0;
+				if(E.vt.enabled || strcmp(optarg, "curses") == 0) break;
+				fprintf(stderr, "Unknown renderer %s\n", optarg);
+				exit(1);
+			case 'w':
+				wrap = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-a autosave_seconds] [-m budget] [-p] [-r curses|vt] [-w] [file]\n", argv[0]);
+				exit(1);
+		}
+	}
 
-	if(argc >= 2) {
-		editorOpen(argv[1]);
+	struct stat st;
+	int toobig = optind < argc && !readonly && E.mem.limit && stat(argv[optind], &st) == 0 && st.st_size > E.mem.limit;
+	if(optind < argc && (readonly || toobig)) {
+		pagerOpen(argv[optind]);
+	}
+	else if(optind < argc) {
+		editorOpen(argv[optind]);
 	}
 	else {
 		initEditor();
 	}
-
-	editorSetStatusMsg("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-Z = undo | Ctrl-Y = redo");
+	E.save.interval = interval;
+	E.softwrap = wrap && !E.pager;
+	signal(SIGPIPE, SIG_IGN);
+
+	editorSetStatusMsg("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-Z = undo | Ctrl-Y = redo | Ctrl-R = revision");
+	if(toobig)
+		editorSetStatusMsg("File is larger than the memory budget, opened read-only");
+	if(E.filename && !E.pager) {
+		struct stat ast;
+		char *autosave = editorAutosavePath(E.filename);
+		if(stat(autosave, &ast) == 0 && stat(E.filename, &st) == 0 && ast.st_mtime >= st.st_mtime)
+			editorSetStatusMsg("Recovery file %s is newer than the file", autosave);
+		free(autosave);
+	}
 
 	while(1) {
 		editorRefreshScreen();
-		editorProcessKeypress();
+		editorIdle();
+		int c = getch();
+		if(c != ERR) {
+			editorProcessKeypress(c);
+			editorColdTick();
+		}
+		editorSaveTick();
+		memEnforce();
 	}
 
 	return 0;
 }
+#endif